@@ -1,170 +1,283 @@
-﻿#include "usn_reader.h"
-#include "usn_utils.h"
-#include "time_utils.h"
-#include "privilege.hpp"
-#include <iostream>
-#include <string>
-#include <vector>
-#include <sstream>
-
-int main(int argc, char* argv[]) {
-
-    if (!EnableDebugPrivilege()) {
-        std::wcerr << L"[!] Failed to enable SeDebugPrivilege (might require admin)\n";
-    }
-
-    if (argc < 2) {
-        std::cout <<
-            "Usage:\n"
-            "  " << argv[0] << " <VOLUME> [OPTIONS]\n\n"
-
-            "Volume:\n"
-            "  C:            Scan the entire USN Journal of volume C:\n\n"
-
-            "Time filters:\n"
-            "  -L            Show entries after current user logon\n"
-            "  -A <DATE>     Show entries after date (YYYY-MM-DD HH:MM:SS)\n\n"
-
-            "File filters:\n"
-            "  -n <names>    Filter by file name(s)   (e.g. test.exe;cmd.dll)\n"
-            "  -r <reasons>  Filter by USN reason(s)  (e.g. File Create;Overwrite)\n"
-            "  -i <ids>      Filter by File ID(s)\n"
-            "  -p <paths>    Filter by path(s)\n"
-            "  -R            Recursive path filtering\n\n"
-
-            "Replace detection:\n"
-            "  -x <types>    Detect replace patterns: (copy;type;explorer;all)\n"
-            "  --only-replace  Show ONLY replace results (no full journal)\n\n"
-
-            "Output:\n"
-            "  -f <formats>  Output format(s): txt;csv;json\n"
-            "  -o <files>    Output file name(s)\n"
-            "  -c            Print results to console\n\n"
-
-            "Other:\n"
-            "  -h            Show this help\n\n"
-
-            "Examples:\n"
-            "  Detect all replaces only:\n"
-            "    " << argv[0] << " C: -L -x all --only-replace\n\n"
-            "  Show entries after logon, filtered by file names, and export to CSV:\n"
-            "    " << argv[0] << " C: -L -n test.exe; cmd.dll -f csv -o results.csv\n\n"
-            "  Filter by path recursively and output to JSON:\n"
-            "    " << argv[0] << " C: -p C:\Users -R -f json -o journal.json\n\n";
-
-        return 0;
-    }
-
-    std::string volStr(argv[1]);
-    std::wstring volume(volStr.begin(), volStr.end());
-    USNJournalReader reader(volume);
-
-    std::vector<std::string> outputFiles = { "usnjrnl.txt" };
-    bool consoleOutput = false;
-
-    for (int i = 2; i < argc; ++i) {
-        std::string arg = argv[i];
-
-        if (arg == "-L") {
-            time_t logonTime = GetCurrentUserLogonTime();
-            if (logonTime) {
-                std::cout << "[+] User logon time: ";
-                print_time(logonTime);
-                reader.EnableAfterLogonFilter(logonTime);
-            }
-            else {
-                std::cerr << "[-] Failed to get logon time\n";
-            }
-        }
-        else if (arg == "-A" && i + 1 < argc) {
-            time_t date = parseDateTime(argv[++i]);
-            if (!date) {
-                std::cerr << "[-] Invalid date format\n";
-                return 1;
-            }
-            reader.filterAfterDate_ = true;
-            reader.filterDate_ = date;
-        }
-        else if (arg == "-n" && i + 1 < argc) {
-            std::stringstream ss(argv[++i]);
-            std::string tok;
-            while (std::getline(ss, tok, ';'))
-                reader.filterNames_.push_back(tok);
-        }
-        else if (arg == "-r" && i + 1 < argc) {
-            std::stringstream ss(argv[++i]);
-            std::string tok;
-            while (std::getline(ss, tok, ';'))
-                reader.filterReasons_.push_back(tok);
-        }
-        else if (arg == "-i" && i + 1 < argc) {
-            std::stringstream ss(argv[++i]);
-            std::string tok;
-            while (std::getline(ss, tok, ';'))
-                reader.filterIds_.push_back(tok);
-        }
-        else if (arg == "-p" && i + 1 < argc) {
-            std::stringstream ss(argv[++i]);
-            std::string tok;
-            while (std::getline(ss, tok, ';'))
-                reader.filterPaths_.push_back(tok);
-        }
-        else if (arg == "-R") {
-            reader.filterPathRecursive_ = true;
-        }
-        else if (arg == "-x" && i + 1 < argc) {
-            std::stringstream ss(argv[++i]);
-            std::string tok;
-            while (std::getline(ss, tok, ';')) {
-                if (tok == "copy") reader.detectReplaces_.push_back(ReplaceType::COPY);
-                else if (tok == "type") reader.detectReplaces_.push_back(ReplaceType::TYPE);
-                else if (tok == "explorer") reader.detectReplaces_.push_back(ReplaceType::EXPLORER);
-                else if (tok == "all") reader.detectReplaces_.push_back(ReplaceType::ALL);
-                else {
-                    std::cerr << "[-] Invalid replace type: " << tok << "\n";
-                    return 1;
-                }
-            }
-        }
-        else if (arg == "--only-replace") {
-            reader.onlyReplace_ = true;
-        }
-        else if (arg == "-f" && i + 1 < argc) {
-            std::stringstream ss(argv[++i]);
-            std::string tok;
-            while (std::getline(ss, tok, ';')) {
-                if (tok == "txt") reader.outputFormats_.push_back(OutputFormat::TXT);
-                else if (tok == "csv") reader.outputFormats_.push_back(OutputFormat::CSV);
-                else if (tok == "json") reader.outputFormats_.push_back(OutputFormat::JSON);
-                else {
-                    std::cerr << "[-] Invalid output format: " << tok << "\n";
-                    return 1;
-                }
-            }
-        }
-        else if (arg == "-o" && i + 1 < argc) {
-            outputFiles.clear();
-            std::stringstream ss(argv[++i]);
-            std::string tok;
-            while (std::getline(ss, tok, ';'))
-                outputFiles.push_back(tok);
-        }
-        else if (arg == "-c") {
-            consoleOutput = true;
-        }
-        else if (arg == "-h") {
-            argc = 1;
-            return main(argc, argv);
-        }
-        else {
-            std::cerr << "[-] Unknown option: " << arg << "\n";
-            return 1;
-        }
-    }
-
-    reader.outputFiles_ = outputFiles;
-    reader.consoleOutput_ = consoleOutput;
-
-    reader.Run();
-    return 0;
+﻿#include "usn_reader.h"
+#include "usn_utils.h"
+#include "time_utils.h"
+#ifdef _WIN32
+#include "privilege.hpp"
+#endif
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdlib>
+
+int main(int argc, char* argv[]) {
+
+#ifdef _WIN32
+    if (!EnableDebugPrivilege()) {
+        std::wcerr << L"[!] Failed to enable SeDebugPrivilege (might require admin)\n";
+    }
+#endif
+
+    if (argc < 2) {
+        std::cout <<
+            "Usage:\n"
+            "  " << argv[0] << " <VOLUME> [OPTIONS]\n"
+            "  " << argv[0] << " --journal-file <PATH> [OPTIONS]\n\n"
+
+            "Volume:\n"
+            "  C:            Scan the entire USN Journal of volume C:\n\n"
+
+            "Input:\n"
+            "  --journal-file <path>  Read an extracted $UsnJrnl:$J stream instead of a live volume\n"
+            "  --mft <path>           Name directories the journal doesn't cover from an extracted $MFT\n"
+            "  --state <file>         Only read what is new since the run that saved file, then update it\n"
+            "  --follow               Keep reading and writing new records until Ctrl+C (txt, csv, ndjson)\n"
+            "  --replay <file>        Follow a recorded journal replayed from scratch, for timing\n"
+            "  --rate <n>             Records per second for --replay (default: as fast as possible)\n\n"
+
+            "Time filters:\n"
+            "  -L            Show entries after current user logon\n"
+            "  -A <DATE>     Show entries after date (YYYY-MM-DD HH:MM:SS)\n\n"
+
+            "File filters:\n"
+            "  -n <names>    Filter by file name(s)   (e.g. test.exe;cmd.dll;*.ps1)\n"
+            "  --ignore-case Match -n names case-insensitively\n"
+            "  -r <reasons>  Filter by USN reason(s)  (e.g. File Create;Overwrite)\n"
+            "  -i <ids>      Filter by File ID(s), exact (decimal, or 0x... for 128-bit IDs)\n"
+            "  --id-segment  Match -i IDs by MFT segment only, ignoring the sequence number\n"
+            "  -p <paths>    Filter by path(s), case-insensitive, subfolders included\n"
+            "  -P <paths>    Exclude path(s)          (e.g. C:\\Windows\\WinSxS)\n"
+            "  -R            Let -p/-P paths match below any folder, not just from the root\n\n"
+
+            "Replace detection:\n"
+            "  -x <types>    Detect replace patterns: (copy;type;explorer;all)\n"
+            "  --patterns <file>  Also detect the per-file patterns defined in file\n"
+            "  --only-replace  Show ONLY replace results (no full journal)\n\n"
+
+            "Output:\n"
+            "  -f <formats>  Output format(s): txt;csv;json;ndjson;arrow\n"
+            "  -o <files>    Output file name(s)\n"
+            "  -z <method>   Compress output files: gzip or zstd (adds .gz/.zst)\n"
+            "  -c            Print results to console\n\n"
+
+            "Performance:\n"
+            "  --threads <n> Parser threads (default: one per CPU)\n\n"
+
+            "Other:\n"
+            "  -h            Show this help\n\n"
+
+            "Examples:\n"
+            "  Detect all replaces only:\n"
+            "    " << argv[0] << " C: -L -x all --only-replace\n\n"
+            "  Show entries after logon, filtered by file names, and export to CSV:\n"
+            "    " << argv[0] << " C: -L -n test.exe; cmd.dll -f csv -o results.csv\n\n"
+            "  Filter by path recursively and output to JSON:\n"
+            "    " << argv[0] << " C: -p C:\\Users -R -f json -o journal.json\n\n"
+            "  Analyse an extracted journal:\n"
+            "    " << argv[0] << " --journal-file $J -x all --only-replace\n\n"
+            "  Analyse an extracted journal with full paths:\n"
+            "    " << argv[0] << " C: --journal-file $J --mft $MFT -f csv -o journal.csv\n\n"
+            "  Sweep only the changes since the previous sweep:\n"
+            "    " << argv[0] << " C: --state sweep.state -x all -f csv -o changes.csv\n\n"
+            "  Watch for replaces as they happen:\n"
+            "    " << argv[0] << " C: -x all --only-replace --follow -c\n\n";
+
+        return 0;
+    }
+
+    std::string volStr(argv[1]);
+    int firstOption = 2;
+    if (volStr.rfind("-", 0) == 0) {
+        volStr.clear();
+        firstOption = 1;
+    }
+    std::wstring volume(volStr.begin(), volStr.end());
+    USNJournalReader reader(volume);
+
+    std::vector<std::string> outputFiles = { "usnjrnl.txt" };
+    bool consoleOutput = false;
+
+    for (int i = firstOption; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "--journal-file" && i + 1 < argc) {
+            reader.journalFile_ = argv[++i];
+        }
+        else if (arg == "--mft" && i + 1 < argc) {
+            reader.mftFile_ = argv[++i];
+        }
+        else if (arg == "--state" && i + 1 < argc) {
+            reader.stateFile_ = argv[++i];
+        }
+        else if (arg == "--follow") {
+            reader.follow_ = true;
+        }
+        else if (arg == "--replay" && i + 1 < argc) {
+            reader.replayFile_ = argv[++i];
+            reader.follow_ = true;
+        }
+        else if (arg == "--rate" && i + 1 < argc) {
+            reader.replayRate_ = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "-L") {
+            time_t logonTime = GetCurrentUserLogonTime();
+            if (logonTime) {
+                std::cout << "[+] User logon time: ";
+                print_time(logonTime);
+                reader.EnableAfterLogonFilter(logonTime);
+            }
+            else {
+                std::cerr << "[-] Failed to get logon time\n";
+            }
+        }
+        else if (arg == "-A" && i + 1 < argc) {
+            time_t date = parseDateTime(argv[++i]);
+            if (!date) {
+                std::cerr << "[-] Invalid date format\n";
+                return 1;
+            }
+            reader.filterAfterDate_ = true;
+            reader.filterDate_ = date;
+        }
+        else if (arg == "--ignore-case") {
+            reader.filterNamesIgnoreCase_ = true;
+        }
+        else if (arg == "-n" && i + 1 < argc) {
+            std::stringstream ss(argv[++i]);
+            std::string tok;
+            while (std::getline(ss, tok, ';'))
+                reader.filterNames_.push_back(tok);
+        }
+        else if (arg == "-r" && i + 1 < argc) {
+            std::stringstream ss(argv[++i]);
+            std::string tok;
+            while (std::getline(ss, tok, ';'))
+                reader.filterReasons_.push_back(tok);
+        }
+        else if (arg == "-i" && i + 1 < argc) {
+            std::stringstream ss(argv[++i]);
+            std::string tok;
+            while (std::getline(ss, tok, ';')) {
+                FileIdKey key;
+                if (!ParseFileId(tok, key)) {
+                    std::cerr << "[-] Invalid file ID: " << tok << "\n";
+                    return 1;
+                }
+                reader.filterIds_.push_back(tok);
+            }
+        }
+        else if (arg == "--id-segment") {
+            reader.filterIdsBySegment_ = true;
+        }
+        else if (arg == "-p" && i + 1 < argc) {
+            std::stringstream ss(argv[++i]);
+            std::string tok;
+            while (std::getline(ss, tok, ';'))
+                reader.filterPaths_.push_back(tok);
+        }
+        else if (arg == "-P" && i + 1 < argc) {
+            std::stringstream ss(argv[++i]);
+            std::string tok;
+            while (std::getline(ss, tok, ';'))
+                reader.filterPathExcludes_.push_back(tok);
+        }
+        else if (arg == "-R") {
+            reader.filterPathRecursive_ = true;
+        }
+        else if (arg == "-x" && i + 1 < argc) {
+            std::stringstream ss(argv[++i]);
+            std::string tok;
+            while (std::getline(ss, tok, ';')) {
+                if (tok == "copy") reader.detectReplaces_.push_back(ReplaceType::COPY);
+                else if (tok == "type") reader.detectReplaces_.push_back(ReplaceType::TYPE);
+                else if (tok == "explorer") reader.detectReplaces_.push_back(ReplaceType::EXPLORER);
+                else if (tok == "all") reader.detectReplaces_.push_back(ReplaceType::ALL);
+                else {
+                    std::cerr << "[-] Invalid replace type: " << tok << "\n";
+                    return 1;
+                }
+            }
+        }
+        else if (arg == "--patterns" && i + 1 < argc) {
+            reader.patternFile_ = argv[++i];
+        }
+        else if (arg == "--only-replace") {
+            reader.onlyReplace_ = true;
+        }
+        else if (arg == "-f" && i + 1 < argc) {
+            std::stringstream ss(argv[++i]);
+            std::string tok;
+            while (std::getline(ss, tok, ';')) {
+                if (tok == "txt") reader.outputFormats_.push_back(OutputFormat::TXT);
+                else if (tok == "csv") reader.outputFormats_.push_back(OutputFormat::CSV);
+                else if (tok == "json") reader.outputFormats_.push_back(OutputFormat::JSON);
+                else if (tok == "ndjson") reader.outputFormats_.push_back(OutputFormat::NDJSON);
+                else if (tok == "arrow") reader.outputFormats_.push_back(OutputFormat::ARROW);
+                else {
+                    std::cerr << "[-] Invalid output format: " << tok << "\n";
+                    return 1;
+                }
+            }
+        }
+        else if (arg == "-o" && i + 1 < argc) {
+            outputFiles.clear();
+            std::stringstream ss(argv[++i]);
+            std::string tok;
+            while (std::getline(ss, tok, ';'))
+                outputFiles.push_back(tok);
+        }
+        else if (arg == "-z" && i + 1 < argc) {
+            std::string method = argv[++i];
+            if (method == "gzip") reader.compression_ = Compression::GZIP;
+            else if (method == "zstd") reader.compression_ = Compression::ZSTD;
+            else {
+                std::cerr << "[-] Invalid compression: " << method << "\n";
+                return 1;
+            }
+            if (!CompressionAvailable(reader.compression_)) {
+                std::cerr << "[-] " << method << " support was not built in\n";
+                return 1;
+            }
+        }
+        else if (arg == "-c") {
+            consoleOutput = true;
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            reader.threads_ = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "-h") {
+            argc = 1;
+            return main(argc, argv);
+        }
+        else {
+            std::cerr << "[-] Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    if (volume.empty() && reader.journalFile_.empty() && reader.replayFile_.empty()) {
+        std::cerr << "[-] No volume or journal file specified\n";
+        return 1;
+    }
+    if (reader.follow_) {
+        for (OutputFormat fmt : reader.outputFormats_) {
+            if (fmt == OutputFormat::JSON || fmt == OutputFormat::ARROW) {
+                std::cerr << "[-] --follow writes txt, csv or ndjson only\n";
+                return 1;
+            }
+        }
+        if (reader.compression_ != Compression::NONE) {
+            std::cerr << "[-] -z can't be used with --follow\n";
+            return 1;
+        }
+        if (!reader.replayFile_.empty() && !reader.stateFile_.empty()) {
+            std::cerr << "[-] --state can't be used with --replay\n";
+            return 1;
+        }
+    }
+
+    reader.outputFiles_ = outputFiles;
+    reader.consoleOutput_ = consoleOutput;
+
+    return reader.Run() ? 0 : 1;
 }
\ No newline at end of file
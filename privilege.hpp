@@ -1,28 +1,28 @@
-#pragma once
-#include <windows.h>
-
-[[nodiscard]] bool EnableDebugPrivilege() {
-    HANDLE hToken = nullptr;
-    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
-        return false;
-
-    LUID luid;
-    if (!LookupPrivilegeValueW(nullptr, SE_DEBUG_NAME, &luid)) {
-        CloseHandle(hToken);
-        return false;
-    }
-
-    TOKEN_PRIVILEGES tp = {};
-    tp.PrivilegeCount = 1;
-    tp.Privileges[0].Luid = luid;
-    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
-
-    if (!AdjustTokenPrivileges(hToken, FALSE, &tp, sizeof(tp), nullptr, nullptr)) {
-        CloseHandle(hToken);
-        return false;
-    }
-
-    bool success = (GetLastError() != ERROR_NOT_ALL_ASSIGNED);
-    CloseHandle(hToken);
-    return success;
+#pragma once
+#include <windows.h>
+
+[[nodiscard]] bool EnableDebugPrivilege() {
+    HANDLE hToken = nullptr;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+        return false;
+
+    LUID luid;
+    if (!LookupPrivilegeValueW(nullptr, SE_DEBUG_NAME, &luid)) {
+        CloseHandle(hToken);
+        return false;
+    }
+
+    TOKEN_PRIVILEGES tp = {};
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Luid = luid;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    if (!AdjustTokenPrivileges(hToken, FALSE, &tp, sizeof(tp), nullptr, nullptr)) {
+        CloseHandle(hToken);
+        return false;
+    }
+
+    bool success = (GetLastError() != ERROR_NOT_ALL_ASSIGNED);
+    CloseHandle(hToken);
+    return success;
 }
\ No newline at end of file
@@ -0,0 +1,223 @@
+// usn_bench: runs the whole reader over an extracted or generated $J and
+// appends one JSON line with its throughput and peak memory, so runs of
+// different builds or settings can be compared. Output files go to the
+// current directory like a normal run; the reader's console output is
+// discarded.
+
+#include "usn_reader.h"
+#include "usn_output.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// Peak resident set of this process so far, in bytes.
+uint64_t PeakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return uint64_t(usage.ru_maxrss) * 1024;  // kilobytes on Linux
+#endif
+}
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+struct BenchOptions {
+    std::string journalFile;
+    std::string mftFile;
+    std::string output = "bench";
+    std::string resultFile;
+    std::string label;
+    size_t threads = 0;
+    size_t runs = 1;
+    std::vector<std::string> names;
+    std::vector<ReplaceType> replaces;
+    std::vector<OutputFormat> formats;
+    Compression compression = Compression::NONE;
+    bool onlyReplace = false;
+};
+
+std::vector<std::string> Split(const std::string& text) {
+    std::vector<std::string> parts;
+    std::stringstream ss(text);
+    std::string tok;
+    while (std::getline(ss, tok, ';'))
+        parts.push_back(tok);
+    return parts;
+}
+
+bool ParseArguments(int argc, char* argv[], BenchOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--journal-file" && hasValue) opt.journalFile = argv[++i];
+        else if (arg == "--mft" && hasValue) opt.mftFile = argv[++i];
+        else if (arg == "--threads" && hasValue) opt.threads = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--runs" && hasValue) opt.runs = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--json" && hasValue) opt.resultFile = argv[++i];
+        else if (arg == "--label" && hasValue) opt.label = argv[++i];
+        else if (arg == "-o" && hasValue) opt.output = argv[++i];
+        else if (arg == "-n" && hasValue) opt.names = Split(argv[++i]);
+        else if (arg == "--only-replace") opt.onlyReplace = true;
+        else if (arg == "-x" && hasValue) {
+            for (const std::string& tok : Split(argv[++i])) {
+                if (tok == "copy") opt.replaces.push_back(ReplaceType::COPY);
+                else if (tok == "type") opt.replaces.push_back(ReplaceType::TYPE);
+                else if (tok == "explorer") opt.replaces.push_back(ReplaceType::EXPLORER);
+                else if (tok == "all") opt.replaces.push_back(ReplaceType::ALL);
+                else return false;
+            }
+        }
+        else if (arg == "-f" && hasValue) {
+            for (const std::string& tok : Split(argv[++i])) {
+                if (tok == "txt") opt.formats.push_back(OutputFormat::TXT);
+                else if (tok == "csv") opt.formats.push_back(OutputFormat::CSV);
+                else if (tok == "json") opt.formats.push_back(OutputFormat::JSON);
+                else if (tok == "ndjson") opt.formats.push_back(OutputFormat::NDJSON);
+                else if (tok == "arrow") opt.formats.push_back(OutputFormat::ARROW);
+                else return false;
+            }
+        }
+        else if (arg == "-z" && hasValue) {
+            std::string method = argv[++i];
+            if (method == "gzip") opt.compression = Compression::GZIP;
+            else if (method == "zstd") opt.compression = Compression::ZSTD;
+            else return false;
+            if (!CompressionAvailable(opt.compression))
+                return false;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The options that shape the run, for the result line.
+std::string RunArguments(int argc, char* argv[]) {
+    std::string text;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--journal-file" || arg == "--json" || arg == "--label") {
+            ++i;
+            continue;
+        }
+        text += (text.empty() ? "" : " ") + arg;
+    }
+    return text;
+}
+
+// One full run; returns the records read.
+size_t RunOnce(const BenchOptions& opt) {
+    USNJournalReader reader(L"");
+    reader.journalFile_ = opt.journalFile;
+    reader.mftFile_ = opt.mftFile;
+    reader.threads_ = opt.threads;
+    reader.filterNames_ = opt.names;
+    reader.detectReplaces_ = opt.replaces;
+    reader.onlyReplace_ = opt.onlyReplace;
+    reader.compression_ = opt.compression;
+    if (!opt.formats.empty())
+        reader.outputFormats_ = opt.formats;
+    reader.outputFiles_ = { opt.output };
+
+    NullBuffer discard;
+    std::streambuf* console = std::cout.rdbuf(&discard);
+    reader.Run();
+    std::cout.rdbuf(console);
+    return reader.RecordsRead();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions opt;
+    if (argc < 2 || !ParseArguments(argc, argv, opt) || opt.journalFile.empty()) {
+        std::cout <<
+            "Usage:\n"
+            "  " << argv[0] << " --journal-file <PATH> [OPTIONS]\n\n"
+
+            "  --journal-file <path>  $J stream to read, e.g. from usn_gen\n"
+            "  --mft <path>           Extracted $MFT, as for the reader\n"
+            "  --threads <n>          Parser threads (default: one per CPU)\n"
+            "  -n, -x, -f, -z, --only-replace  As for the reader\n"
+            "  -o <name>              Entry output file name (default: bench)\n"
+            "  --runs <n>             Runs to time; the median is reported (default: 1)\n"
+            "  --label <text>         Tag for the result line, e.g. a build or commit\n"
+            "  --json <file>          Append the result line to file instead of printing it\n\n"
+
+            "Example:\n"
+            "  " << argv[0] << " --journal-file bench.J -x all -f csv --runs 5 --json results.ndjson\n";
+        return argc < 2 ? 0 : 1;
+    }
+
+    std::error_code ec;
+    uint64_t bytes = std::filesystem::file_size(opt.journalFile, ec);
+    if (ec) {
+        std::cerr << "[-] Failed to open journal file: " << opt.journalFile << "\n";
+        return 1;
+    }
+
+    std::vector<double> seconds;
+    size_t records = 0;
+    for (size_t run = 0; run < opt.runs; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        records = RunOnce(opt);
+        seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        std::cerr << std::format("[+] Run {}: {} records in {:.3f} seconds\n", run + 1, records, seconds.back());
+    }
+
+    std::vector<double> sorted = seconds;
+    std::sort(sorted.begin(), sorted.end());
+    double median = sorted[sorted.size() / 2];
+    size_t threads = opt.threads ? opt.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    std::string line = std::format(
+        "{{\"label\":\"{}\",\"corpus\":\"{}\",\"arguments\":\"{}\",\"bytes\":{},\"records\":{},\"threads\":{},"
+        "\"seconds\":[",
+        JsonEscape(opt.label), JsonEscape(opt.journalFile), JsonEscape(RunArguments(argc, argv)), bytes, records, threads);
+    for (size_t run = 0; run < seconds.size(); ++run)
+        line += std::format("{}{:.6f}", run ? "," : "", seconds[run]);
+    line += std::format("],\"median_seconds\":{:.6f},\"records_per_second\":{:.0f},\"mb_per_second\":{:.1f},\"peak_rss_mb\":{:.1f}}}\n",
+        median, records / median, bytes / median / (1 << 20), PeakResidentBytes() / double(1 << 20));
+
+    if (opt.resultFile.empty()) {
+        std::cout << line;
+        return 0;
+    }
+    std::ofstream out(opt.resultFile, std::ios::app | std::ios::binary);
+    out << line;
+    if (!out) {
+        std::cerr << "[-] Failed to write " << opt.resultFile << "\n";
+        return 1;
+    }
+    std::cerr << "[+] Result appended to " << opt.resultFile << "\n";
+    return 0;
+}
\ No newline at end of file
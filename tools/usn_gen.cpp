@@ -0,0 +1,373 @@
+// usn_gen: writes a synthetic $UsnJrnl:$J stream for benchmarks.
+//
+// The stream is laid out like an extracted journal: an optional zeroed
+// prefix, then records packed into 4 KB pages, each record's USN being its
+// offset. A directory tree is created first, then file events follow in the
+// configured mix. Copy, type and explorer replaces are injected at fixed
+// intervals with the reason sequences of usn_patterns.h, each on a file of
+// its own. An injected copy also matches the type patterns, so the summary
+// printed at the end gives the counts the reader's -x all should report,
+// with the copies among the type replaces.
+
+#include "usn_journal_writer.h"
+#include "usn_patterns.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr ULONGLONG kStartTime = 133485408000000000ULL;  // 2024-01-01 00:00 UTC
+constexpr ULONGLONG kRootReference = (5ULL << 48) | 5;   // the root directory, MFT record 5
+
+struct Options {
+    std::string output;
+    uint64_t records = 1000000;
+    int version = 2;               // 4 = V3 records plus V4 range records after data changes
+    size_t directories = 10000;
+    size_t names = 50000;
+    double skew = 1.0;             // Zipf exponent of name and directory picks, 0 = uniform
+    uint64_t sparseBytes = 0;
+    uint32_t seed = 1;
+    double copyRate = 50;          // injected sequences per million records
+    double typeRate = 50;
+    double explorerRate = 50;
+
+    // event weights: create, write, delete, rename, attribute change
+    double mix[5] = { 30, 40, 10, 10, 10 };
+};
+
+enum Event { CREATE, WRITE, DELETE, RENAME, ATTRIBUTE, kEventCount };
+const char* const kEventNames[] = { "create", "write", "delete", "rename", "attrib" };
+
+// Samples 0..n-1 with probability proportional to 1 / (i + 1)^skew.
+class ZipfTable {
+public:
+    ZipfTable(size_t n, double skew) : cdf_(n) {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += 1.0 / std::pow(double(i + 1), skew);
+            cdf_[i] = sum;
+        }
+    }
+
+    size_t Pick(std::mt19937_64& rng) const {
+        double u = std::uniform_real_distribution<double>(0, cdf_.back())(rng);
+        return std::min<size_t>(std::upper_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin(), cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+struct LiveFile {
+    ULONGLONG reference;
+    uint32_t directory;
+    uint32_t name;
+};
+
+class Generator {
+public:
+    explicit Generator(const Options& opt)
+        : opt_(opt), rng_(opt.seed), file_(opt.output, std::ios::binary | std::ios::trunc),
+          writer_(file_, opt.sparseBytes, opt.version >= 3),
+          nameTable_(opt.names, opt.skew), directoryTable_(opt.directories + 1, opt.skew),
+          eventPick_(std::begin(opt.mix), std::end(opt.mix)) {}
+
+    bool Run() {
+        if (!writer_.ok()) {
+            std::cerr << "[-] Failed to create " << opt_.output << "\n";
+            return false;
+        }
+
+        MakeNames();
+        MakeDirectories();
+
+        const double rates[3] = { opt_.copyRate, opt_.typeRate, opt_.explorerRate };
+        double interval[3], next[3];
+        for (int k = 0; k < 3; ++k) {
+            interval[k] = rates[k] > 0 ? 1e6 / rates[k] : 0;
+            next[k] = interval[k];
+        }
+
+        while (writer_.Records() < opt_.records) {
+            bool injected = false;
+            for (int k = 0; k < 3 && !injected; ++k) {
+                if (interval[k] > 0 && double(writer_.Records()) >= next[k] && Inject(k)) {
+                    next[k] += interval[k];
+                    injected = true;
+                }
+            }
+            if (!injected)
+                Emit(live_.empty() ? CREATE : Event(eventPick_(rng_)));
+        }
+
+        bool written = writer_.Finish();
+        file_.close();
+        if (!written || !file_) {
+            std::cerr << "[-] Failed to write " << opt_.output << "\n";
+            return false;
+        }
+
+        std::cout << std::format("[+] Wrote {} records, {} bytes, to {}\n", writer_.Records(), writer_.Offset(), opt_.output);
+        std::cout << "[+] Events:";
+        for (int e = 0; e < kEventCount; ++e)
+            std::cout << (e ? ", " : " ") << kEventNames[e] << " " << events_[e];
+        std::cout << "\n";
+        std::cout << std::format("[+] Injected replaces: copy {}, type {}, explorer {}\n", injected_[0], injected_[1], injected_[2]);
+        std::cout << std::format("[+] Expected with -x all: copy {}, type {} (copies included), explorer {}\n",
+            injected_[0], injected_[0] + injected_[1], injected_[2]);
+        return true;
+    }
+
+private:
+    // Names are drawn from a fixed pool, popular ones first; a few carry
+    // characters outside ASCII so the UTF-8 paths are exercised too.
+    void MakeNames() {
+        static const char* const extensions[] = { "txt", "dll", "exe", "log", "tmp", "json", "png", "docx", "ps1", "dat" };
+        static const char16_t* const accents[] = { u"r\u00e9sum\u00e9", u"\u00fcbersicht", u"\u6587\u4ef6", u"\u0444\u0430\u0439\u043b" };
+        names_.reserve(opt_.names);
+        for (size_t i = 0; i < opt_.names; ++i) {
+            std::string ascii = std::format("file{:x}.{}", i, extensions[rng_() % std::size(extensions)]);
+            std::u16string name(ascii.begin(), ascii.end());
+            if (rng_() % 50 == 0)
+                name.insert(0, std::u16string(accents[rng_() % std::size(accents)]) + u"_");
+            names_.push_back(std::move(name));
+        }
+    }
+
+    // Each directory hangs below a random earlier one, so depth grows with
+    // the log of the count.
+    void MakeDirectories() {
+        directories_.push_back(kRootReference);
+        directoryNames_.push_back(u".");
+        for (size_t i = 1; i <= opt_.directories; ++i) {
+            ULONGLONG parent = directories_[std::uniform_int_distribution<size_t>(0, i - 1)(rng_)];
+            ULONGLONG reference = NewReference();
+            std::string ascii = std::format("dir{}", i);
+            directories_.push_back(reference);
+            directoryNames_.emplace_back(ascii.begin(), ascii.end());
+            Record(reference, parent, USN_REASON_FILE_CREATE, FILE_ATTRIBUTE_DIRECTORY, directoryNames_.back());
+            Record(reference, parent, USN_REASON_FILE_CREATE | USN_REASON_CLOSE, FILE_ATTRIBUTE_DIRECTORY, directoryNames_.back());
+        }
+    }
+
+    // Background events never carry Data Truncation and renames always
+    // change the name, so none of them can complete a replace pattern.
+    void Emit(Event event) {
+        ++events_[event];
+        if (event == CREATE) {
+            LiveFile file{ NewReference(), uint32_t(directoryTable_.Pick(rng_)), uint32_t(nameTable_.Pick(rng_)) };
+            live_.push_back(file);
+            Record(file, USN_REASON_FILE_CREATE);
+            Record(file, USN_REASON_FILE_CREATE | USN_REASON_DATA_EXTEND | USN_REASON_CLOSE);
+            return;
+        }
+
+        size_t at = std::uniform_int_distribution<size_t>(0, live_.size() - 1)(rng_);
+        LiveFile& file = live_[at];
+        switch (event) {
+        case WRITE:
+            Record(file, USN_REASON_DATA_OVERWRITE);
+            if (opt_.version == 4)
+                writer_.WriteExtent(file.reference, directories_[file.directory], USN_REASON_DATA_OVERWRITE,
+                    LONGLONG(rng_() % 1024) * 4096, 4096);
+            Record(file, USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_EXTEND | USN_REASON_CLOSE);
+            break;
+        case DELETE:
+            Record(file, USN_REASON_FILE_DELETE | USN_REASON_CLOSE);
+            Retire(at);
+            break;
+        case RENAME:
+            if (rng_() % 20 == 0) {
+                RenameDirectory();
+                break;
+            }
+            Record(file, USN_REASON_RENAME_OLD_NAME);
+            {
+                uint32_t renamed = uint32_t(nameTable_.Pick(rng_));
+                file.name = renamed != file.name ? renamed : uint32_t((renamed + 1) % opt_.names);
+            }
+            Record(file, USN_REASON_RENAME_NEW_NAME);
+            Record(file, USN_REASON_RENAME_NEW_NAME | USN_REASON_CLOSE);
+            break;
+        default:
+            Record(file, (rng_() % 2 ? USN_REASON_BASIC_INFO_CHANGE : USN_REASON_SECURITY_CHANGE) | USN_REASON_CLOSE);
+            break;
+        }
+    }
+
+    void RenameDirectory() {
+        if (directories_.size() < 2)
+            return;
+        size_t i = std::uniform_int_distribution<size_t>(1, directories_.size() - 1)(rng_);
+        ULONGLONG parent = directories_[std::uniform_int_distribution<size_t>(0, i - 1)(rng_)];
+        Record(directories_[i], parent, USN_REASON_RENAME_OLD_NAME, FILE_ATTRIBUTE_DIRECTORY, directoryNames_[i]);
+        std::string ascii = std::format("dir{}_{}", i, writer_.Records());
+        directoryNames_[i].assign(ascii.begin(), ascii.end());
+        Record(directories_[i], parent, USN_REASON_RENAME_NEW_NAME, FILE_ATTRIBUTE_DIRECTORY, directoryNames_[i]);
+        Record(directories_[i], parent, USN_REASON_RENAME_NEW_NAME | USN_REASON_CLOSE, FILE_ATTRIBUTE_DIRECTORY, directoryNames_[i]);
+    }
+
+    // Writes one replace on a live file, which then leaves the pool.
+    bool Inject(int kind) {
+        if (live_.empty())
+            return false;
+        size_t at = std::uniform_int_distribution<size_t>(0, live_.size() - 1)(rng_);
+        LiveFile file = live_[at];
+        Retire(at);
+
+        bool alternate = injected_[kind] % 2 != 0;
+        if (kind == 0) {
+            for (DWORD step : alternate ? COPY_PATTERN_2 : COPY_PATTERN_1)
+                Record(file, step);
+        }
+        else if (kind == 1) {
+            for (DWORD step : alternate ? TYPE_PATTERN_2 : TYPE_PATTERN_1)
+                Record(file, step);
+        }
+        else {
+            // the saved file is written under a new ID and renamed over the old one
+            LiveFile saved{ NewReference(), file.directory, file.name };
+            Record(file, EXPLORER_PATTERN[0]);
+            for (size_t step = 1; step < EXPLORER_PATTERN.size(); ++step)
+                Record(saved, EXPLORER_PATTERN[step]);
+        }
+        ++injected_[kind];
+        return true;
+    }
+
+    void Retire(size_t at) {
+        live_[at] = live_.back();
+        live_.pop_back();
+    }
+
+    void Record(const LiveFile& file, DWORD reason) {
+        Record(file.reference, directories_[file.directory], reason, 0x20, names_[file.name]);
+    }
+
+    void Record(ULONGLONG reference, ULONGLONG parent, DWORD reason, DWORD attributes, const std::u16string& name) {
+        time_ += std::uniform_int_distribution<ULONGLONG>(0, 20000)(rng_);
+        writer_.Write(reference, parent, time_, reason, attributes, name);
+    }
+
+    ULONGLONG NewReference() {
+        return (1ULL << 48) | nextSegment_++;
+    }
+
+    const Options& opt_;
+    std::mt19937_64 rng_;
+    std::ofstream file_;
+    JournalWriter writer_;
+    ZipfTable nameTable_;
+    ZipfTable directoryTable_;
+    std::discrete_distribution<int> eventPick_;
+    std::vector<std::u16string> names_;
+    std::vector<ULONGLONG> directories_;
+    std::vector<std::u16string> directoryNames_;
+    std::vector<LiveFile> live_;
+    ULONGLONG nextSegment_ = 64;  // above the NTFS metadata files
+    ULONGLONG time_ = kStartTime;
+    uint64_t events_[kEventCount] = {};
+    uint64_t injected_[3] = {};
+};
+
+bool ParseMix(const std::string& text, double (&mix)[kEventCount]) {
+    std::stringstream ss(text);
+    std::string tok;
+    while (std::getline(ss, tok, ',')) {
+        size_t eq = tok.find('=');
+        if (eq == std::string::npos)
+            return false;
+        auto name = std::find(std::begin(kEventNames), std::end(kEventNames), tok.substr(0, eq));
+        if (name == std::end(kEventNames))
+            return false;
+        mix[name - std::begin(kEventNames)] = std::strtod(tok.c_str() + eq + 1, nullptr);
+    }
+    double total = 0;
+    for (double w : mix) {
+        if (w < 0)
+            return false;
+        total += w;
+    }
+    return total > 0;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout <<
+            "Usage:\n"
+            "  " << argv[0] << " -o <FILE> [OPTIONS]\n\n"
+
+            "  -o <file>          Output $J stream\n"
+            "  -n <records>       Records to write (default: 1000000)\n"
+            "  --version <2|3|4>  Record version; 3 uses 128-bit IDs, 4 adds V4 range records (default: 2)\n"
+            "  --dirs <n>         Directories in the tree (default: 10000)\n"
+            "  --names <n>        Distinct file names (default: 50000)\n"
+            "  --skew <s>         Zipf exponent of name and directory picks, 0 = uniform (default: 1)\n"
+            "  --mix <weights>    Event weights (default: create=30,write=40,delete=10,rename=10,attrib=10)\n"
+            "  --sparse <MB>      Zeroed prefix before the first record, as in a wrapped journal\n"
+            "  --copy <n>         Copy replaces injected per million records (default: 50)\n"
+            "  --type <n>         Type replaces injected per million records (default: 50)\n"
+            "  --explorer <n>     Explorer replaces injected per million records (default: 50)\n"
+            "  --seed <n>         Random seed (default: 1)\n\n"
+
+            "Example:\n"
+            "  " << argv[0] << " -o bench.J -n 10000000 --version 3 --sparse 512\n";
+        return 0;
+    }
+
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "-o" && hasValue) opt.output = argv[++i];
+        else if (arg == "-n" && hasValue) opt.records = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--version" && hasValue) opt.version = std::atoi(argv[++i]);
+        else if (arg == "--dirs" && hasValue) opt.directories = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--names" && hasValue) opt.names = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--skew" && hasValue) opt.skew = std::strtod(argv[++i], nullptr);
+        else if (arg == "--sparse" && hasValue) opt.sparseBytes = std::strtoull(argv[++i], nullptr, 10) << 20;
+        else if (arg == "--copy" && hasValue) opt.copyRate = std::strtod(argv[++i], nullptr);
+        else if (arg == "--type" && hasValue) opt.typeRate = std::strtod(argv[++i], nullptr);
+        else if (arg == "--explorer" && hasValue) opt.explorerRate = std::strtod(argv[++i], nullptr);
+        else if (arg == "--seed" && hasValue) opt.seed = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--mix" && hasValue) {
+            if (!ParseMix(argv[++i], opt.mix)) {
+                std::cerr << "[-] Invalid event mix: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else {
+            std::cerr << "[-] Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    if (opt.output.empty()) {
+        std::cerr << "[-] No output file specified\n";
+        return 1;
+    }
+    if (opt.version < 2 || opt.version > 4) {
+        std::cerr << "[-] Record version must be 2, 3 or 4\n";
+        return 1;
+    }
+    if (opt.names < 2 || opt.skew < 0) {
+        std::cerr << "[-] Invalid name distribution\n";
+        return 1;
+    }
+
+    Generator generator(opt);
+    return generator.Run() ? 0 : 1;
+}
\ No newline at end of file
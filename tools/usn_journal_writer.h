@@ -0,0 +1,120 @@
+#pragma once
+
+#include "usn_platform.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Writes USN records the way NTFS lays out $J: records packed into pages,
+// with a page padded with zeros where the next record would cross into the
+// following one, and each record's USN being its offset. out must be opened
+// in binary mode; an std::ostringstream gives the stream in memory.
+class JournalWriter {
+public:
+    JournalWriter(std::ostream& out, uint64_t sparseBytes, bool wideIds)
+        : out_(out), offset_(sparseBytes), wideIds_(wideIds) {
+        buffer_.reserve(kBufferSize);
+        // the prefix is left as a hole where the file system supports it
+        if (sparseBytes)
+            out_.seekp(std::streamoff(sparseBytes));
+    }
+
+    bool ok() const { return out_.good(); }
+    uint64_t Offset() const { return offset_ + buffer_.size(); }
+    uint64_t Records() const { return records_; }
+
+    void Write(ULONGLONG file, ULONGLONG parent, ULONGLONG time, DWORD reason, DWORD attributes, const std::u16string& name) {
+        DWORD nameBytes = DWORD(name.size() * sizeof(WCHAR));
+        if (wideIds_) {
+            USN_RECORD_V3 rec{};
+            FillNamed(rec, 3, offsetof(USN_RECORD_V3, FileName), time, reason, attributes, nameBytes);
+            PutId(rec.FileReferenceNumber, file);
+            PutId(rec.ParentFileReferenceNumber, parent);
+            Append(&rec, offsetof(USN_RECORD_V3, FileName), name, rec.RecordLength);
+        }
+        else {
+            USN_RECORD_V2 rec{};
+            FillNamed(rec, 2, offsetof(USN_RECORD_V2, FileName), time, reason, attributes, nameBytes);
+            rec.FileReferenceNumber = file;
+            rec.ParentFileReferenceNumber = parent;
+            Append(&rec, offsetof(USN_RECORD_V2, FileName), name, rec.RecordLength);
+        }
+    }
+
+    // One range-tracking record with a single extent.
+    void WriteExtent(ULONGLONG file, ULONGLONG parent, DWORD reason, LONGLONG offset, LONGLONG length) {
+        USN_RECORD_V4 rec{};
+        rec.Header.RecordLength = sizeof(USN_RECORD_V4);
+        rec.Header.MajorVersion = 4;
+        PutId(rec.FileReferenceNumber, file);
+        PutId(rec.ParentFileReferenceNumber, parent);
+        StartRecord(rec.Header.RecordLength);
+        rec.Usn = USN(Offset());
+        rec.Reason = reason;
+        rec.NumberOfExtents = 1;
+        rec.ExtentSize = sizeof(USN_RECORD_EXTENT);
+        rec.Extents[0] = { offset, length };
+        Append(&rec, sizeof(rec), {}, rec.Header.RecordLength);
+    }
+
+    // Writes what is still buffered. False if the stream failed.
+    bool Finish() {
+        Flush();
+        out_.flush();
+        return !out_.fail();
+    }
+
+private:
+    static constexpr size_t kPageSize = 4096;
+    static constexpr size_t kBufferSize = 4 << 20;
+
+    template <class Record>
+    void FillNamed(Record& rec, WORD version, size_t nameOffset, ULONGLONG time, DWORD reason, DWORD attributes, DWORD nameBytes) {
+        rec.RecordLength = DWORD((nameOffset + nameBytes + 7) & ~size_t(7));
+        rec.MajorVersion = version;
+        StartRecord(rec.RecordLength);
+        rec.Usn = USN(Offset());
+        rec.TimeStamp.QuadPart = LONGLONG(time);
+        rec.Reason = reason;
+        rec.FileAttributes = attributes;
+        rec.FileNameLength = WORD(nameBytes);
+        rec.FileNameOffset = WORD(nameOffset);
+    }
+
+    static void PutId(FILE_ID_128& id, ULONGLONG reference) {
+        memset(&id, 0, sizeof(id));
+        memcpy(id.Identifier, &reference, sizeof(reference));
+    }
+
+    void StartRecord(size_t length) {
+        size_t used = Offset() % kPageSize;
+        if (used + length > kPageSize)
+            buffer_.resize(buffer_.size() + kPageSize - used, 0);
+        if (buffer_.size() + length > kBufferSize)
+            Flush();
+    }
+
+    void Append(const void* header, size_t headerBytes, const std::u16string& name, size_t length) {
+        size_t at = buffer_.size();
+        buffer_.resize(at + length, 0);
+        memcpy(buffer_.data() + at, header, headerBytes);
+        if (!name.empty())
+            memcpy(buffer_.data() + at + headerBytes, name.data(), name.size() * sizeof(WCHAR));
+        ++records_;
+    }
+
+    void Flush() {
+        out_.write(reinterpret_cast<const char*>(buffer_.data()), std::streamsize(buffer_.size()));
+        offset_ += buffer_.size();
+        buffer_.clear();
+    }
+
+    std::ostream& out_;
+    std::vector<BYTE> buffer_;
+    uint64_t offset_;
+    uint64_t records_ = 0;
+    bool wideIds_;
+};
\ No newline at end of file
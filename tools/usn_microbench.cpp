@@ -0,0 +1,353 @@
+// usn_microbench: times the per-record and per-file hot paths of the reader
+// one at a time, over a journal built in memory from a fixed seed, so two
+// builds given the same options see the same records. Each case reports the
+// median and best nanoseconds per item over a few samples.
+
+#include "usn_journal_writer.h"
+#include "usn_reader.h"
+#include "usn_output.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Results are folded in here so the timed work can't be optimised away.
+volatile uint64_t sink = 0;
+
+struct BenchCase {
+    std::string name;
+    size_t items;                  // per call of run
+    std::function<void()> run;
+};
+
+struct CaseResult {
+    double median;                 // ns per item
+    double best;
+};
+
+double SecondsOf(const std::function<void()>& run, size_t calls) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; ++i)
+        run();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Doubles the calls per sample until one takes minSeconds, then takes samples.
+CaseResult Measure(const BenchCase& bench, double minSeconds, size_t samples) {
+    size_t calls = 1;
+    SecondsOf(bench.run, 1);
+    while (SecondsOf(bench.run, calls) < minSeconds)
+        calls *= 2;
+
+    std::vector<double> times;
+    for (size_t s = 0; s < samples; ++s)
+        times.push_back(SecondsOf(bench.run, calls) * 1e9 / (double(calls) * bench.items));
+    std::sort(times.begin(), times.end());
+    return { times[times.size() / 2], times.front() };
+}
+
+// A V2 $J stream in memory: a directory tree, then files created, written,
+// renamed and deleted, with copy, type and explorer replaces mixed in so the
+// detector has real matches to make.
+std::vector<BYTE> BuildJournal(size_t records, uint32_t seed) {
+    std::mt19937_64 rng(seed);
+    std::ostringstream stream(std::ios::binary);
+    JournalWriter writer(stream, 0, false);
+    ULONGLONG time = 133485408000000000ULL;
+    ULONGLONG nextSegment = 64;
+
+    static const char16_t* const stems[] = { u"setup", u"report", u"cmd", u"notes", u"r\u00e9sum\u00e9", u"\u6587\u4ef6", u"data", u"log" };
+    static const char16_t* const extensions[] = { u".exe", u".dll", u".txt", u".ps1", u".json", u".tmp" };
+    auto randomName = [&] {
+        std::u16string name = stems[rng() % std::size(stems)];
+        std::string number = std::to_string(rng() % 500);
+        name.append(number.begin(), number.end());
+        return name + extensions[rng() % std::size(extensions)];
+    };
+
+    auto put = [&](ULONGLONG file, ULONGLONG parent, DWORD reason, DWORD attributes, const std::u16string& name) {
+        time += rng() % 20000;
+        writer.Write(file, parent, time, reason, attributes, name);
+    };
+
+    std::vector<ULONGLONG> directories = { (5ULL << 48) | 5 };
+    for (size_t i = 0; i < std::max<size_t>(1, records / 100) && writer.Records() < records; ++i) {
+        ULONGLONG reference = (1ULL << 48) | nextSegment++;
+        std::string ascii = "dir" + std::to_string(i);
+        put(reference, directories[rng() % directories.size()], USN_REASON_FILE_CREATE | USN_REASON_CLOSE,
+            FILE_ATTRIBUTE_DIRECTORY, std::u16string(ascii.begin(), ascii.end()));
+        directories.push_back(reference);
+    }
+
+    while (writer.Records() < records) {
+        ULONGLONG file = (1ULL << 48) | nextSegment++;
+        ULONGLONG parent = directories[rng() % directories.size()];
+        std::u16string name = randomName();
+        switch (rng() % 10) {
+        case 0:
+            for (DWORD step : COPY_PATTERN_1)
+                put(file, parent, step, 0x20, name);
+            break;
+        case 1:
+            for (DWORD step : TYPE_PATTERN_1)
+                put(file, parent, step, 0x20, name);
+            break;
+        case 2:
+            put(file, parent, EXPLORER_PATTERN[0], 0x20, name);
+            file = (1ULL << 48) | nextSegment++;
+            for (size_t step = 1; step < EXPLORER_PATTERN.size(); ++step)
+                put(file, parent, EXPLORER_PATTERN[step], 0x20, name);
+            break;
+        case 3:
+            put(file, parent, USN_REASON_RENAME_OLD_NAME, 0x20, name);
+            put(file, parent, USN_REASON_RENAME_NEW_NAME | USN_REASON_CLOSE, 0x20, randomName());
+            break;
+        case 4:
+            put(file, parent, USN_REASON_FILE_DELETE | USN_REASON_CLOSE, 0x20, name);
+            break;
+        default:
+            put(file, parent, USN_REASON_FILE_CREATE, 0x20, name);
+            put(file, parent, USN_REASON_DATA_EXTEND | USN_REASON_CLOSE, 0x20, name);
+            put(file, parent, USN_REASON_DATA_OVERWRITE | USN_REASON_BASIC_INFO_CHANGE | USN_REASON_CLOSE, 0x20, name);
+            break;
+        }
+    }
+    writer.Finish();
+    std::string bytes = stream.str();
+    return std::vector<BYTE>(bytes.begin(), bytes.end());
+}
+
+}
+
+// Reaches into USNJournalReader to time its private stages on their own.
+class ReaderMicroBench {
+public:
+    ReaderMicroBench(size_t records, uint32_t seed) : journal_(BuildJournal(records, seed)), rng_(seed) {
+        const BYTE* ptr = journal_.data();
+        const BYTE* end = ptr + journal_.size();
+        while (ptr < end) {
+            UsnRecordView rec;
+            if (!ParseUsnRecord(ptr, end - ptr, rec)) {
+                ptr += 8;
+                continue;
+            }
+            views_.push_back(rec);
+            ptr += rec.recordLength;
+        }
+
+        // the full reader state, as after a run over the journal
+        Prepare(reader_);
+        reader_.detectReplaces_ = { ReplaceType::ALL };
+        reader_.replaces_.Configure(BuiltinReplacePatterns(true, true), true);
+        reader_.ParseRange(journal_.data(), journal_.data() + journal_.size(), true);
+        reader_.ResolveDirectories();
+    }
+
+    size_t Records() const { return views_.size(); }
+    size_t Bytes() const { return journal_.size(); }
+
+    std::vector<BenchCase> Cases() {
+        std::vector<BenchCase> cases;
+        const UsnEntryStore& entries = reader_.entries_;
+
+        // ReasonToString builds the text; ReasonText is its per-mask cache
+        reasons_.resize(4096);
+        for (DWORD& reason : reasons_)
+            reason = views_[rng_() % views_.size()].reason | (rng_() % 4 == 0 ? DWORD(rng_()) : 0);
+        cases.push_back({ "reason/ReasonToString", reasons_.size(), [this] {
+            for (DWORD reason : reasons_)
+                sink = sink + reader_.ReasonToString(reason).size();
+        } });
+        cases.push_back({ "reason/ReasonText", reasons_.size(), [this] {
+            for (DWORD reason : reasons_)
+                sink = sink + reader_.ReasonText(reason).size();
+        } });
+
+        // one filter stage at a time, each set to reject about half
+        AddFilter(cases, "filter/none", [](USNJournalReader&) {});
+        AddFilter(cases, "filter/time", [this](USNJournalReader& r) {
+            r.filterAfterDate_ = true;
+            r.filterDate_ = time_t(views_[views_.size() / 2].Ticks() / 10000000ULL - 11644473600ULL);
+        });
+        AddFilter(cases, "filter/reason", [](USNJournalReader& r) { r.filterReasons_ = { "Data Extend", "Rename" }; });
+        AddFilter(cases, "filter/file-id", [this](USNJournalReader& r) {
+            for (size_t i = 0; i < 64; ++i)
+                r.filterIds_.push_back(FormatFileId(views_[rng_() % views_.size()].fileId));
+        });
+        AddFilter(cases, "filter/name", [](USNJournalReader& r) { r.filterNames_ = { "*.exe", "cmd*.dll", "setup1?.txt" }; });
+        AddFilter(cases, "filter/name-ignore-case", [](USNJournalReader& r) {
+            r.filterNames_ = { "*.EXE", "CMD*.dll", "Setup1?.txt" };
+            r.filterNamesIgnoreCase_ = true;
+        });
+        pathFilter_.Compile({ "\\dir1", "\\dir3" }, { "\\dir1\\dir15" }, true);
+        cases.push_back({ "filter/path", entries.size(), [this, &entries] {
+            for (size_t i = 0; i < entries.size(); ++i)
+                sink = sink + pathFilter_.Accepts(entries.Directory(i));
+        } });
+
+        cases.push_back({ "parse/ParseRecords", views_.size(), [this] {
+            USNJournalReader::ParsedRecords out;
+            reader_.ParseRecords(journal_.data(), journal_.data() + journal_.size(), journal_.data() + journal_.size(), true, out);
+            sink = sink + out.entries.size();
+        } });
+
+        // FileIdHash on both ID widths, and the packed key hash the tables use
+        for (bool wide : { false, true }) {
+            for (const UsnRecordView& rec : views_)
+                ids_[wide].push_back(MakeFileIdVariant(MakeFileIdKey(rec.fileId), wide));
+            cases.push_back({ wide ? "hash/FileIdHash-128" : "hash/FileIdHash-64", views_.size(), [this, wide] {
+                for (const FileIdVariant& fid : ids_[wide])
+                    sink = sink + FileIdHash{}(fid);
+            } });
+            cases.push_back({ wide ? "hash/HashFileIdKey-128" : "hash/HashFileIdKey-64", views_.size(), [this, wide] {
+                for (const FileIdVariant& fid : ids_[wide])
+                    sink = sink + HashFileIdKey(MakeFileIdKey(fid));
+            } });
+        }
+
+        cases.push_back({ "aggregate/Build", entries.size(), [&entries] {
+            FileAggregation files;
+            files.Build(entries);
+            sink = sink + files.size();
+        } });
+        cases.push_back({ "aggregate/EventsFileID", entries.size(), [this] {
+            reader_.aggregated_ = false;
+            sink = sink + reader_.EventsFileID().size();
+        } });
+
+        // one detector per kind, the way -x copy, -x type and -x explorer run
+        AddReplace(cases, "replace/copy", BuiltinReplacePatterns(true, false), false);
+        AddReplace(cases, "replace/type", BuiltinReplacePatterns(false, true), false);
+        AddReplace(cases, "replace/explorer", {}, true);
+        AddReplace(cases, "replace/all", BuiltinReplacePatterns(true, true), true);
+
+        // the formatters of WriteIndividualToFile, over strings already in UTF-8
+        names_ = std::make_unique<Utf8Cache>(entries.Names());
+        directories_ = std::make_unique<Utf8Cache>(entries.Directories());
+        names_->ConvertAll(*reader_.pool_);
+        directories_->ConvertAll(*reader_.pool_);
+        reader_.WarmReasonText(entries);
+        const std::pair<const char*, OutputFormat> formats[] = {
+            { "format/txt", OutputFormat::TXT }, { "format/csv", OutputFormat::CSV },
+            { "format/json", OutputFormat::JSON }, { "format/ndjson", OutputFormat::NDJSON } };
+        for (const auto& [name, fmt] : formats) {
+            cases.push_back({ name, entries.size(), [this, fmt, &entries] {
+                out_.Clear();
+                reader_.RenderEntries(out_, fmt, 0, entries.size(), *names_, *directories_);
+                sink = sink + out_.Contents().size();
+            } });
+        }
+        return cases;
+    }
+
+private:
+    static void Prepare(USNJournalReader& reader) {
+        reader.pool_ = std::make_unique<ThreadPool>(1);
+        reader.PrepareFilters();
+    }
+
+    template <class Configure>
+    void AddFilter(std::vector<BenchCase>& cases, const char* name, Configure configure) {
+        auto& reader = filterReaders_.emplace_back(std::make_unique<USNJournalReader>(L""));
+        configure(*reader);
+        Prepare(*reader);
+        cases.push_back({ name, views_.size(), [this, r = reader.get()] {
+            for (const UsnRecordView& rec : views_)
+                sink = sink + r->FilterRecord(rec, rec.name);
+        } });
+    }
+
+    void AddReplace(std::vector<BenchCase>& cases, const char* name, std::vector<ReplacePatternDef> patterns, bool explorer) {
+        cases.push_back({ name, reader_.entries_.size(), [this, patterns = std::move(patterns), explorer] {
+            ReplaceDetector detector;
+            detector.Configure(patterns, explorer);
+            for (size_t i = 0; i < reader_.entries_.size(); ++i)
+                detector.Push(reader_.entries_, i);
+            sink = sink + detector.Matches().size();
+        } });
+    }
+
+    std::vector<BYTE> journal_;
+    std::mt19937_64 rng_;
+    std::vector<UsnRecordView> views_;
+    USNJournalReader reader_{ L"" };
+    std::vector<std::unique_ptr<USNJournalReader>> filterReaders_;
+    std::vector<DWORD> reasons_;
+    std::vector<FileIdVariant> ids_[2];
+    PathFilter pathFilter_;
+    std::unique_ptr<Utf8Cache> names_;
+    std::unique_ptr<Utf8Cache> directories_;
+    OutputBuffer out_;
+};
+
+int main(int argc, char* argv[]) {
+    size_t records = 200000;
+    uint32_t seed = 1;
+    double minSeconds = 0.05;
+    size_t samples = 7;
+    std::string filter;
+    std::string resultFile;
+    std::string label;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--records" && hasValue) records = std::max<size_t>(1000, std::strtoull(argv[++i], nullptr, 10));
+        else if (arg == "--seed" && hasValue) seed = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--min-time" && hasValue) minSeconds = std::strtod(argv[++i], nullptr);
+        else if (arg == "--samples" && hasValue) samples = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--filter" && hasValue) filter = argv[++i];
+        else if (arg == "--json" && hasValue) resultFile = argv[++i];
+        else if (arg == "--label" && hasValue) label = argv[++i];
+        else {
+            std::cout <<
+                "Usage:\n"
+                "  " << argv[0] << " [OPTIONS]\n\n"
+
+                "  --records <n>    Records in the generated journal (default: 200000)\n"
+                "  --seed <n>       Seed of the generated journal (default: 1)\n"
+                "  --min-time <s>   Shortest sample, in seconds (default: 0.05)\n"
+                "  --samples <n>    Samples per case; the median is reported (default: 7)\n"
+                "  --filter <text>  Only run the cases whose name contains text\n"
+                "  --label <text>   Tag for the result lines, e.g. a build or commit\n"
+                "  --json <file>    Also append one JSON line per case to file\n";
+            return arg == "-h" ? 0 : 1;
+        }
+    }
+
+    ReaderMicroBench bench(records, seed);
+    std::cout << std::format("[+] {} records, {} bytes, seed {}\n", bench.Records(), bench.Bytes(), seed);
+
+    std::ofstream results;
+    if (!resultFile.empty()) {
+        results.open(resultFile, std::ios::app | std::ios::binary);
+        if (!results) {
+            std::cerr << "[-] Failed to open " << resultFile << "\n";
+            return 1;
+        }
+    }
+
+    std::cout << std::format("{:<28}{:>14}{:>14}\n", "case", "ns/item", "best");
+    for (const BenchCase& benchCase : bench.Cases()) {
+        if (!filter.empty() && benchCase.name.find(filter) == std::string::npos)
+            continue;
+        CaseResult result = Measure(benchCase, minSeconds, samples);
+        std::cout << std::format("{:<28}{:>14.2f}{:>14.2f}\n", benchCase.name, result.median, result.best);
+        if (results.is_open()) {
+            results << std::format("{{\"label\":\"{}\",\"case\":\"{}\",\"records\":{},\"seed\":{},\"ns_per_item\":{:.3f},\"best_ns_per_item\":{:.3f}}}\n",
+                JsonEscape(label), benchCase.name, records, seed, result.median, result.best);
+        }
+    }
+    return 0;
+}
\ No newline at end of file
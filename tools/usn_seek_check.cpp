@@ -0,0 +1,126 @@
+// usn_seek_check: checks that the time seek of -A changes nothing but the
+// work done. Reads a $J file twice with the same filters, once with -A and
+// once without it, applies the time filter to the rows of the full read,
+// and compares them with the rows of the seeking one, directories included.
+// Exits 1 on the first difference.
+
+#include "usn_reader.h"
+#include "usn_utils.h"
+#include "time_utils.h"
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace {
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+struct CheckOptions {
+    std::string journalFile;
+    std::string mftFile;
+    time_t after = 0;
+    std::vector<std::string> paths;
+    bool recursive = false;
+};
+
+std::vector<std::string> Split(const std::string& text) {
+    std::vector<std::string> parts;
+    std::stringstream ss(text);
+    std::string tok;
+    while (std::getline(ss, tok, ';'))
+        parts.push_back(tok);
+    return parts;
+}
+
+bool ParseArguments(int argc, char* argv[], CheckOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--journal-file" && hasValue) opt.journalFile = argv[++i];
+        else if (arg == "--mft" && hasValue) opt.mftFile = argv[++i];
+        else if (arg == "-p" && hasValue) opt.paths = Split(argv[++i]);
+        else if (arg == "-R") opt.recursive = true;
+        else if (arg == "-A" && hasValue) {
+            opt.after = parseDateTime(argv[++i]);
+            if (!opt.after)
+                return false;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The rows of one read, with or without -A.
+std::vector<USNEntry> Read(const CheckOptions& opt, bool seek) {
+    USNJournalReader reader(L"");
+    reader.journalFile_ = opt.journalFile;
+    reader.mftFile_ = opt.mftFile;
+    reader.filterPaths_ = opt.paths;
+    reader.filterPathRecursive_ = opt.recursive;
+    reader.filterAfterDate_ = seek;
+    reader.filterDate_ = seek ? opt.after : 0;
+    reader.consoleOutput_ = true;
+
+    NullBuffer discard;
+    std::streambuf* console = std::cout.rdbuf(&discard);
+    reader.Run();
+    std::cout.rdbuf(console);
+    return reader.GetEntriesCopy();
+}
+
+bool SameRow(const USNEntry& a, const USNEntry& b) {
+    return a.usn == b.usn && a.reason == b.reason && a.name == b.name && a.directory == b.directory
+        && FileIdEqual{}(a.fileId, b.fileId);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    CheckOptions opt;
+    if (argc < 2 || !ParseArguments(argc, argv, opt) || opt.journalFile.empty() || !opt.after) {
+        std::cout <<
+            "Usage:\n"
+            "  " << argv[0] << " --journal-file <PATH> -A <DATE> [OPTIONS]\n\n"
+
+            "  --journal-file <path>  $J stream to read, e.g. from usn_gen\n"
+            "  -A <date>              Time window start, as for the reader\n"
+            "  -p, -R, --mft          As for the reader\n\n"
+
+            "Example:\n"
+            "  " << argv[0] << " --journal-file bench.J -A \"2024-01-01 00:30:00\" -p \\dir2\n";
+        return argc < 2 ? 0 : 1;
+    }
+
+    std::vector<USNEntry> full = Read(opt, false);
+    std::vector<USNEntry> expected;
+    for (auto& entry : full) {
+        if (LocalFileTimeToTimeT(entry.date) >= opt.after)
+            expected.push_back(std::move(entry));
+    }
+    std::vector<USNEntry> seeking = Read(opt, true);
+
+    std::cout << std::format("[+] Full read then time filter: {} rows, seeking read: {} rows\n", expected.size(), seeking.size());
+    for (size_t i = 0; i < std::max(expected.size(), seeking.size()); ++i) {
+        if (i < expected.size() && i < seeking.size() && SameRow(expected[i], seeking[i]))
+            continue;
+        if (i < expected.size())
+            std::cout << std::format("[-] Row {} should be USN {} in {}\n", i, expected[i].usn, to_utf8(expected[i].directory));
+        if (i < seeking.size())
+            std::cout << std::format("[-] Row {} is USN {} in {}\n", i, seeking[i].usn, to_utf8(seeking[i].directory));
+        return 1;
+    }
+    std::cout << "[+] Same rows\n";
+    return 0;
+}
\ No newline at end of file
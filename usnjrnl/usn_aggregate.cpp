@@ -0,0 +1,32 @@
+#include "usn_aggregate.h"
+
+// Counting sort: one pass numbers the files and counts their events, a
+// second drops every entry index into its file's span. A file's records
+// mostly come in runs, so the previous record's file skips the table.
+void FileAggregation::Build(const UsnEntryStore& entries) {
+    FileIdIndex files;
+    std::vector<uint32_t> fileOf(entries.size());
+    std::vector<uint32_t> counts;
+    FileIdKey lastKey;
+    uint32_t file = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        FileIdKey key = entries.FileKey(i);
+        if (i == 0 || !(key == lastKey)) {
+            file = files.Intern(key);
+            lastKey = key;
+        }
+        if (file == counts.size())
+            counts.push_back(0);
+        ++counts[file];
+        fileOf[i] = file;
+    }
+
+    offsets_.assign(counts.size() + 1, 0);
+    for (size_t file = 0; file < counts.size(); ++file)
+        offsets_[file + 1] = offsets_[file] + counts[file];
+
+    events_.resize(entries.size());
+    std::vector<uint32_t> next(offsets_.begin(), offsets_.end() - 1);
+    for (size_t i = 0; i < entries.size(); ++i)
+        events_[next[fileOf[i]]++] = static_cast<uint32_t>(i);
+}
\ No newline at end of file
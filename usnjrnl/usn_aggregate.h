@@ -0,0 +1,25 @@
+#pragma once
+
+#include "usn_entry_store.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Entries grouped by file id. Files are numbered in the order they first
+// appear and each one is a span of entry indices in USN order, which is
+// also time order, so nothing is copied or sorted.
+class FileAggregation {
+public:
+    void Build(const UsnEntryStore& entries);
+
+    size_t size() const { return offsets_.size() - 1; }
+    std::span<const uint32_t> Events(size_t file) const {
+        return std::span<const uint32_t>(events_.data() + offsets_[file], offsets_[file + 1] - offsets_[file]);
+    }
+    uint32_t FirstEvent(size_t file) const { return events_[offsets_[file]]; }
+    uint32_t LastEvent(size_t file) const { return events_[offsets_[file + 1] - 1]; }
+
+private:
+    std::vector<uint32_t> offsets_{ 0 };
+    std::vector<uint32_t> events_;
+};
\ No newline at end of file
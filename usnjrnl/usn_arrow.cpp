@@ -0,0 +1,395 @@
+#include "usn_arrow.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// The IPC metadata is FlatBuffers. The few tables Arrow needs are built by
+// hand with a minimal back-to-front builder instead of generated code, which
+// keeps the format free of a runtime dependency. Field ids follow Schema.fbs,
+// Message.fbs and File.fbs of the Arrow format.
+
+namespace {
+
+class FlatBuilder {
+public:
+    using Ref = uint32_t;  // object position, counted from the end of the buffer
+
+    // Pads so that after extra more bytes the size is a multiple of align.
+    void Align(size_t align, size_t extra = 0) {
+        maxAlign_ = std::max(maxAlign_, align);
+        while ((size() + extra) % align)
+            Prepend<uint8_t>(0);
+    }
+
+    template <class T>
+    void Prepend(T value) {
+        data_.insert(data_.begin(), sizeof(T), 0);
+        memcpy(data_.data(), &value, sizeof(T));
+    }
+
+    template <class T>
+    void Push(T value) {
+        Align(sizeof(T));
+        Prepend(value);
+    }
+
+    Ref String(std::string_view text) {
+        Align(4, text.size() + 1);
+        Prepend<uint8_t>(0);
+        data_.insert(data_.begin(), text.begin(), text.end());
+        Prepend(static_cast<uint32_t>(text.size()));
+        return Ref(size());
+    }
+
+    // Vector of structs of structSize bytes, laid out back to back.
+    Ref StructVector(const void* items, size_t count, size_t structSize) {
+        Align(8, count * structSize);
+        const auto* bytes = static_cast<const uint8_t*>(items);
+        data_.insert(data_.begin(), bytes, bytes + count * structSize);
+        Prepend(static_cast<uint32_t>(count));
+        return Ref(size());
+    }
+
+    Ref TableVector(const std::vector<Ref>& tables) {
+        Align(4, tables.size() * 4);
+        for (size_t i = tables.size(); i-- > 0;)
+            Push(RelativeTo(tables[i]));
+        Prepend(static_cast<uint32_t>(tables.size()));
+        return Ref(size());
+    }
+
+    void StartTable() {
+        fields_.clear();
+        tableStart_ = size();
+    }
+    template <class T>
+    void Field(uint16_t id, T value) {
+        Push(value);
+        fields_.push_back({ id, Ref(size()) });
+    }
+    void FieldRef(uint16_t id, Ref ref) {
+        Push(RelativeTo(ref));
+        fields_.push_back({ id, Ref(size()) });
+    }
+    Ref EndTable() {
+        Push<int32_t>(0);
+        Ref table = Ref(size());
+        uint16_t fieldCount = 0;
+        for (const auto& field : fields_)
+            fieldCount = std::max<uint16_t>(fieldCount, uint16_t(field.first + 1));
+
+        std::vector<uint16_t> offsets(fieldCount, 0);
+        for (const auto& field : fields_)
+            offsets[field.first] = uint16_t(table - field.second);
+        for (size_t i = offsets.size(); i-- > 0;)
+            Prepend(offsets[i]);
+        Prepend(uint16_t(table - tableStart_));
+        Prepend(uint16_t(4 + 2 * fieldCount));
+
+        // the table starts with the distance back to its vtable
+        int32_t toVtable = int32_t(size() - table);
+        memcpy(data_.data() + size() - table, &toVtable, sizeof(toVtable));
+        return table;
+    }
+
+    std::vector<uint8_t> Finish(Ref root) {
+        Align(std::max<size_t>(maxAlign_, 8), 4);
+        Push(RelativeTo(root));
+        return std::move(data_);
+    }
+
+private:
+    size_t size() const { return data_.size(); }
+    uint32_t RelativeTo(Ref ref) {
+        Align(4);
+        return uint32_t(size() + 4 - ref);
+    }
+
+    // Metadata stays a few KB, so prepending into a vector is cheap enough.
+    std::vector<uint8_t> data_;
+    std::vector<std::pair<uint16_t, Ref>> fields_;
+    size_t tableStart_ = 0;
+    size_t maxAlign_ = 1;
+};
+
+enum : uint8_t { kTypeInt = 2, kTypeUtf8 = 5, kTypeTimestamp = 10, kTypeFixedSizeBinary = 15 };
+enum : uint8_t { kHeaderSchema = 1, kHeaderDictionaryBatch = 2, kHeaderRecordBatch = 3 };
+constexpr int16_t kMetadataV5 = 4;
+constexpr int16_t kNanosecond = 3;
+constexpr int64_t kNameDictionary = 0;
+constexpr int64_t kDirectoryDictionary = 1;
+constexpr ULONGLONG kUnixEpochTicks = 116444736000000000ULL;
+
+struct FieldNode {
+    int64_t length;
+    int64_t nullCount;
+};
+struct BufferSpec {
+    int64_t offset;
+    int64_t length;
+};
+struct Block {
+    int64_t offset;
+    int32_t metaDataLength;
+    int32_t padding;
+    int64_t bodyLength;
+};
+
+FlatBuilder::Ref IntType(FlatBuilder& fb, int32_t bits, bool isSigned) {
+    fb.StartTable();
+    fb.Field<int32_t>(0, bits);
+    fb.Field<uint8_t>(1, isSigned);
+    return fb.EndTable();
+}
+
+FlatBuilder::Ref BuildSchema(FlatBuilder& fb) {
+    auto field = [&](std::string_view name, uint8_t typeType, FlatBuilder::Ref type, int64_t dictionary) {
+        FlatBuilder::Ref nameRef = fb.String(name);
+        FlatBuilder::Ref encoding = 0;
+        if (dictionary >= 0) {
+            FlatBuilder::Ref indexType = IntType(fb, 32, true);
+            fb.StartTable();
+            fb.Field<int64_t>(0, dictionary);
+            fb.FieldRef(1, indexType);
+            encoding = fb.EndTable();
+        }
+        FlatBuilder::Ref children = fb.TableVector({});
+        fb.StartTable();
+        fb.FieldRef(0, nameRef);
+        fb.Field<uint8_t>(1, 0);
+        fb.Field<uint8_t>(2, typeType);
+        fb.FieldRef(3, type);
+        if (dictionary >= 0)
+            fb.FieldRef(4, encoding);
+        fb.FieldRef(5, children);
+        return fb.EndTable();
+    };
+
+    std::vector<FlatBuilder::Ref> fields;
+    fields.push_back(field("usn", kTypeInt, IntType(fb, 64, false), -1));
+
+    // no timezone: the store holds local time, as the text formats print it
+    fb.StartTable();
+    fb.Field<int16_t>(0, kNanosecond);
+    fields.push_back(field("date", kTypeTimestamp, fb.EndTable(), -1));
+
+    fields.push_back(field("reason", kTypeInt, IntType(fb, 32, false), -1));
+
+    fb.StartTable();
+    fb.Field<int32_t>(0, 16);
+    fields.push_back(field("file_id", kTypeFixedSizeBinary, fb.EndTable(), -1));
+
+    fb.StartTable();
+    FlatBuilder::Ref utf8 = fb.EndTable();
+    fields.push_back(field("name", kTypeUtf8, utf8, kNameDictionary));
+    fields.push_back(field("directory", kTypeUtf8, utf8, kDirectoryDictionary));
+
+    FlatBuilder::Ref fieldVector = fb.TableVector(fields);
+    fb.StartTable();
+    fb.FieldRef(1, fieldVector);
+    return fb.EndTable();
+}
+
+FlatBuilder::Ref BuildRecordBatch(FlatBuilder& fb, int64_t length, const std::vector<FieldNode>& nodes,
+    const std::vector<BufferSpec>& buffers) {
+    FlatBuilder::Ref nodeVector = fb.StructVector(nodes.data(), nodes.size(), sizeof(FieldNode));
+    FlatBuilder::Ref bufferVector = fb.StructVector(buffers.data(), buffers.size(), sizeof(BufferSpec));
+    fb.StartTable();
+    fb.Field<int64_t>(0, length);
+    fb.FieldRef(1, nodeVector);
+    fb.FieldRef(2, bufferVector);
+    return fb.EndTable();
+}
+
+std::vector<uint8_t> BuildMessage(FlatBuilder& fb, uint8_t headerType, FlatBuilder::Ref header, int64_t bodyLength) {
+    fb.StartTable();
+    fb.Field<int64_t>(3, bodyLength);
+    fb.FieldRef(2, header);
+    fb.Field<int16_t>(0, kMetadataV5);
+    fb.Field<uint8_t>(1, headerType);
+    return fb.Finish(fb.EndTable());
+}
+
+size_t Padded(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+// Lays the buffers of one batch out back to back, each padded to 8 bytes.
+class Body {
+public:
+    void Add(const void* data, size_t size) {
+        buffers_.push_back({ int64_t(bytes_.size()), int64_t(size) });
+        const auto* p = static_cast<const char*>(data);
+        bytes_.insert(bytes_.end(), p, p + size);
+        bytes_.resize(Padded(bytes_.size()), 0);
+    }
+    void AddEmpty() { buffers_.push_back({ int64_t(bytes_.size()), 0 }); }
+
+    const std::vector<BufferSpec>& Buffers() const { return buffers_; }
+    const std::vector<char>& Bytes() const { return bytes_; }
+
+private:
+    std::vector<BufferSpec> buffers_;
+    std::vector<char> bytes_;
+};
+
+class IpcFile {
+public:
+    explicit IpcFile(std::ostream& out) : out_(out) {}
+
+    void Raw(const void* data, size_t size) {
+        out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        position_ += size;
+    }
+
+    // Continuation marker, metadata length, metadata padded to 8, body.
+    Block Message(const std::vector<uint8_t>& metadata, const std::vector<char>& body) {
+        static const char zeros[8] = {};
+        Block block{ int64_t(position_), 0, 0, int64_t(body.size()) };
+        uint32_t marker = 0xFFFFFFFF;
+        int32_t length = int32_t(Padded(8 + metadata.size()) - 8);
+        Raw(&marker, 4);
+        Raw(&length, 4);
+        Raw(metadata.data(), metadata.size());
+        Raw(zeros, length - metadata.size());
+        Raw(body.data(), body.size());
+        block.metaDataLength = 8 + length;
+        return block;
+    }
+
+    size_t position() const { return position_; }
+
+private:
+    std::ostream& out_;
+    size_t position_ = 0;
+};
+
+bool DictionaryBody(Utf8Cache& cache, size_t count, Body& body, std::string& error) {
+    std::vector<int32_t> offsets(count + 1, 0);
+    std::string chars;
+    for (size_t id = 0; id < count; ++id) {
+        chars += cache.Get(static_cast<uint32_t>(id));
+        if (chars.size() > INT32_MAX) {
+            error = "string dictionary exceeds 2 GB";
+            return false;
+        }
+        offsets[id + 1] = int32_t(chars.size());
+    }
+    body.AddEmpty();
+    body.Add(offsets.data(), offsets.size() * sizeof(int32_t));
+    body.Add(chars.data(), chars.size());
+    return true;
+}
+
+}
+
+bool WriteArrowFile(std::ostream& out, const UsnEntryStore& entries, Utf8Cache& names, Utf8Cache& directories,
+    std::string& error) {
+    IpcFile file(out);
+    file.Raw("ARROW1\0\0", 8);
+
+    {
+        FlatBuilder fb;
+        file.Message(BuildMessage(fb, kHeaderSchema, BuildSchema(fb), 0), {});
+    }
+
+    std::vector<Block> dictionaries;
+    for (int64_t id : { kNameDictionary, kDirectoryDictionary }) {
+        const StringPool& pool = id == kNameDictionary ? entries.Names() : entries.Directories();
+        Body body;
+        if (!DictionaryBody(id == kNameDictionary ? names : directories, pool.size(), body, error))
+            return false;
+
+        FlatBuilder fb;
+        std::vector<FieldNode> nodes = { { int64_t(pool.size()), 0 } };
+        FlatBuilder::Ref data = BuildRecordBatch(fb, int64_t(pool.size()), nodes, body.Buffers());
+        fb.StartTable();
+        fb.Field<int64_t>(0, id);
+        fb.FieldRef(1, data);
+        FlatBuilder::Ref batch = fb.EndTable();
+        dictionaries.push_back(file.Message(BuildMessage(fb, kHeaderDictionaryBatch, batch, int64_t(body.Bytes().size())), body.Bytes()));
+    }
+
+    std::vector<Block> batches;
+    std::vector<ULONGLONG> usn;
+    std::vector<int64_t> date;
+    std::vector<uint8_t> dateValid;
+    std::vector<DWORD> reason;
+    std::vector<FileIdKey> fileId;
+    std::vector<uint32_t> name;
+    std::vector<uint32_t> directory;
+    for (size_t first = 0; first < entries.size(); first += kArrowBatchRows) {
+        size_t count = std::min(kArrowBatchRows, entries.size() - first);
+        usn.resize(count);
+        date.resize(count);
+        dateValid.assign((count + 7) / 8, 0);
+        int64_t dateNulls = 0;
+        reason.resize(count);
+        fileId.resize(count);
+        name.resize(count);
+        directory.resize(count);
+        for (size_t row = 0; row < count; ++row) {
+            size_t i = first + row;
+            FILETIME ft = entries.Date(i);
+            ULONGLONG ticks = (ULONGLONG(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+            usn[row] = entries.Usn(i);
+            // V4 records carry no timestamp
+            if (ticks) {
+                date[row] = (int64_t(ticks) - int64_t(kUnixEpochTicks)) * 100;
+                dateValid[row / 8] |= uint8_t(1 << (row % 8));
+            }
+            else {
+                date[row] = 0;
+                ++dateNulls;
+            }
+            reason[row] = entries.Reason(i);
+            fileId[row] = entries.FileKey(i);
+            name[row] = entries.NameId(i);
+            directory[row] = entries.DirectoryId(i);
+        }
+
+        Body body;
+        auto column = [&](const auto& values) {
+            body.AddEmpty();
+            body.Add(values.data(), values.size() * sizeof(values[0]));
+        };
+        column(usn);
+        if (dateNulls) {
+            body.Add(dateValid.data(), dateValid.size());
+            body.Add(date.data(), date.size() * sizeof(date[0]));
+        }
+        else {
+            column(date);
+        }
+        column(reason);
+        column(fileId);
+        column(name);
+        column(directory);
+
+        FlatBuilder fb;
+        std::vector<FieldNode> nodes(6, { int64_t(count), 0 });
+        nodes[1].nullCount = dateNulls;
+        FlatBuilder::Ref batch = BuildRecordBatch(fb, int64_t(count), nodes, body.Buffers());
+        batches.push_back(file.Message(BuildMessage(fb, kHeaderRecordBatch, batch, int64_t(body.Bytes().size())), body.Bytes()));
+    }
+
+    uint32_t endOfStream[2] = { 0xFFFFFFFF, 0 };
+    file.Raw(endOfStream, sizeof(endOfStream));
+
+    FlatBuilder fb;
+    FlatBuilder::Ref schema = BuildSchema(fb);
+    FlatBuilder::Ref dictionaryBlocks = fb.StructVector(dictionaries.data(), dictionaries.size(), sizeof(Block));
+    FlatBuilder::Ref batchBlocks = fb.StructVector(batches.data(), batches.size(), sizeof(Block));
+    fb.StartTable();
+    fb.FieldRef(1, schema);
+    fb.FieldRef(2, dictionaryBlocks);
+    fb.FieldRef(3, batchBlocks);
+    fb.Field<int16_t>(0, kMetadataV5);
+    std::vector<uint8_t> footer = fb.Finish(fb.EndTable());
+
+    int32_t footerLength = int32_t(footer.size());
+    file.Raw(footer.data(), footer.size());
+    file.Raw(&footerLength, 4);
+    file.Raw("ARROW1", 6);
+    return static_cast<bool>(out);
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "usn_entry_store.h"
+#include "usn_output.h"
+#include <ostream>
+#include <string>
+
+// Writes entries as an Arrow IPC file (Feather v2), which pandas, polars and
+// DuckDB map without parsing:
+//   usn        uint64
+//   date       timestamp[ns], local time like the text formats; null for
+//              V4 records, which carry none
+//   reason     uint32, the raw USN_REASON_* bits
+//   file_id    fixed_size_binary[16], the FILE_ID_128 bytes (64-bit ids
+//              zero-extended)
+//   name       dictionary<int32, utf8>
+//   directory  dictionary<int32, utf8>
+// The dictionaries are the store's string pools, written once up front, so
+// the name and directory columns are just the pool ids. Rows follow in
+// record batches of kArrowBatchRows. out must be opened in binary mode.
+inline constexpr size_t kArrowBatchRows = 65536;
+
+bool WriteArrowFile(std::ostream& out, const UsnEntryStore& entries, Utf8Cache& names, Utf8Cache& directories,
+    std::string& error);
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include "usn_compress.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef USN_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USN_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// Fast levels: the point is to keep up with the formatter, and CSV/JSON
+// still shrink about 8x at these.
+constexpr int kGzipLevel = 1;
+constexpr int kZstdLevel = 3;
+
+}
+
+bool CompressionAvailable(Compression c) {
+    switch (c) {
+    case Compression::NONE: return true;
+#ifdef USN_HAVE_ZLIB
+    case Compression::GZIP: return true;
+#endif
+#ifdef USN_HAVE_ZSTD
+    case Compression::ZSTD: return true;
+#endif
+    default: return false;
+    }
+}
+
+const char* CompressionExtension(Compression c) {
+    switch (c) {
+    case Compression::GZIP: return ".gz";
+    case Compression::ZSTD: return ".zst";
+    default: return "";
+    }
+}
+
+CompressingStreamBuf::CompressingStreamBuf(std::ostream& sink, Compression compression, size_t threads, size_t blockSize)
+    : sink_(sink), compression_(compression), blockSize_(blockSize) {
+    threads = std::max<size_t>(1, threads);
+    maxInFlight_ = threads * 2;
+    current_.reserve(blockSize_);
+    for (size_t i = 0; i < threads; ++i)
+        compressors_.emplace_back(&CompressingStreamBuf::CompressLoop, this);
+    writer_ = std::thread(&CompressingStreamBuf::WriteLoop, this);
+}
+
+CompressingStreamBuf::~CompressingStreamBuf() {
+    Finish();
+}
+
+CompressingStreamBuf::int_type CompressingStreamBuf::overflow(int_type ch) {
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+        return traits_type::not_eof(ch);
+    current_.push_back(traits_type::to_char_type(ch));
+    if (current_.size() >= blockSize_)
+        Submit();
+    return ch;
+}
+
+std::streamsize CompressingStreamBuf::xsputn(const char* data, std::streamsize size) {
+    std::streamsize left = size;
+    while (left > 0) {
+        size_t take = std::min<size_t>(static_cast<size_t>(left), blockSize_ - current_.size());
+        current_.append(data, take);
+        data += take;
+        left -= static_cast<std::streamsize>(take);
+        if (current_.size() >= blockSize_)
+            Submit();
+    }
+    return size;
+}
+
+void CompressingStreamBuf::Submit() {
+    auto block = std::make_unique<Block>();
+    block->input = std::move(current_);
+    current_ = std::string();
+    current_.reserve(blockSize_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    written_.wait(lock, [&] { return submitted_ - nextToWrite_ < maxInFlight_; });
+    blocks_.emplace(submitted_++, std::move(block));
+    work_.notify_one();
+}
+
+void CompressingStreamBuf::CompressLoop() {
+    void* context = nullptr;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        work_.wait(lock, [&] { return nextToCompress_ < submitted_ || closing_; });
+        if (nextToCompress_ == submitted_)
+            break;
+        Block& block = *blocks_[nextToCompress_++];
+
+        lock.unlock();
+        bool ok = Compress(block, context);
+        lock.lock();
+        failed_ |= !ok;
+        block.compressed = true;
+        ready_.notify_all();
+    }
+
+#ifdef USN_HAVE_ZSTD
+    if (context)
+        ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(context));
+#endif
+}
+
+void CompressingStreamBuf::WriteLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        ready_.wait(lock, [&] {
+            auto it = blocks_.find(nextToWrite_);
+            return (it != blocks_.end() && it->second->compressed) || (closing_ && nextToWrite_ == submitted_);
+        });
+        auto it = blocks_.find(nextToWrite_);
+        if (it == blocks_.end())
+            break;
+        std::unique_ptr<Block> block = std::move(it->second);
+        blocks_.erase(it);
+
+        lock.unlock();
+        sink_.write(block->output.data(), static_cast<std::streamsize>(block->output.size()));
+        block.reset();
+        lock.lock();
+        ++nextToWrite_;
+        written_.notify_all();
+    }
+}
+
+// Each block is a complete gzip member or zstd frame. On failure the output
+// stays empty and false is returned; Finish() reports it.
+bool CompressingStreamBuf::Compress(Block& block, [[maybe_unused]] void*& context) const {
+    const std::string& in = block.input;
+    std::string& out = block.output;
+
+#ifdef USN_HAVE_ZLIB
+    if (compression_ == Compression::GZIP) {
+        z_stream zs{};
+        if (deflateInit2(&zs, kGzipLevel, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        out.resize(deflateBound(&zs, static_cast<uLong>(in.size())));
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        zs.avail_in = static_cast<uInt>(in.size());
+        zs.next_out = reinterpret_cast<Bytef*>(out.data());
+        zs.avail_out = static_cast<uInt>(out.size());
+        int status = deflate(&zs, Z_FINISH);
+        out.resize(status == Z_STREAM_END ? zs.total_out : 0);
+        deflateEnd(&zs);
+        return status == Z_STREAM_END;
+    }
+#endif
+#ifdef USN_HAVE_ZSTD
+    if (compression_ == Compression::ZSTD) {
+        if (!context)
+            context = ZSTD_createCCtx();
+        if (!context)
+            return false;
+        out.resize(ZSTD_compressBound(in.size()));
+        size_t size = ZSTD_compressCCtx(static_cast<ZSTD_CCtx*>(context), out.data(), out.size(), in.data(), in.size(), kZstdLevel);
+        out.resize(ZSTD_isError(size) ? 0 : size);
+        return !ZSTD_isError(size);
+    }
+#endif
+    out = in;
+    return true;
+}
+
+bool CompressingStreamBuf::Finish() {
+    if (finished_)
+        return !failed_ && sink_;
+    // an empty file still gets one (empty) member, so it decompresses
+    if (!current_.empty() || submitted_ == 0)
+        Submit();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    work_.notify_all();
+    ready_.notify_all();
+    for (auto& thread : compressors_)
+        thread.join();
+    writer_.join();
+    finished_ = true;
+    return !failed_ && sink_;
+}
+
+CompressedOfstream::CompressedOfstream(const std::string& path, Compression compression, size_t threads)
+    : std::ostream(nullptr), file_(path, std::ios::binary) {
+    if (!file_) {
+        setstate(std::ios::failbit);
+        return;
+    }
+    buffer_ = std::make_unique<CompressingStreamBuf>(file_, compression, threads);
+    rdbuf(buffer_.get());
+}
+
+bool CompressedOfstream::close() {
+    if (!buffer_ || !file_.is_open())
+        return !fail();
+    if (!buffer_->Finish())
+        setstate(std::ios::badbit);
+    file_.close();
+    return !fail();
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if __has_include(<zlib.h>)
+#define USN_HAVE_ZLIB 1
+#endif
+#if __has_include(<zstd.h>)
+#define USN_HAVE_ZSTD 1
+#endif
+
+enum class Compression { NONE, GZIP, ZSTD };
+
+// False when this build was made without the library for c.
+bool CompressionAvailable(Compression c);
+
+// ".gz", ".zst", or "" for NONE.
+const char* CompressionExtension(Compression c);
+
+// Stream buffer that compresses on background threads. Writes fill blocks;
+// each full block goes to one of the compressor threads and becomes a gzip
+// member or zstd frame of its own, so blocks compress in parallel, and one
+// writer thread appends them to the sink in order. Concatenated members and
+// frames are valid .gz and .zst files. Only a few blocks per thread are in
+// flight; past that, writes wait for the compressors.
+class CompressingStreamBuf : public std::streambuf {
+public:
+    CompressingStreamBuf(std::ostream& sink, Compression compression, size_t threads, size_t blockSize = 4 << 20);
+    ~CompressingStreamBuf() override;
+
+    // Compresses what is left and waits for every block to be written.
+    // False if a block failed to compress or the sink failed.
+    bool Finish();
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* data, std::streamsize size) override;
+
+private:
+    struct Block {
+        std::string input;
+        std::string output;
+        bool compressed = false;
+    };
+
+    void Submit();
+    void CompressLoop();
+    void WriteLoop();
+    bool Compress(Block& block, void*& context) const;
+
+    std::ostream& sink_;
+    Compression compression_;
+    size_t blockSize_;
+    size_t maxInFlight_;
+    std::string current_;
+
+    std::mutex mutex_;
+    std::condition_variable work_;      // a block to compress, or closing
+    std::condition_variable written_;   // a block left the pipeline
+    std::condition_variable ready_;     // a block got compressed
+    std::map<size_t, std::unique_ptr<Block>> blocks_;  // by sequence, until written
+    size_t nextToCompress_ = 0;
+    size_t submitted_ = 0;
+    size_t nextToWrite_ = 0;
+    bool closing_ = false;
+    bool failed_ = false;               // a block failed to compress
+    bool finished_ = false;
+
+    std::vector<std::thread> compressors_;
+    std::thread writer_;
+};
+
+// A file opened through CompressingStreamBuf; usable wherever an
+// std::ofstream is. Check it like one: it is false when the file couldn't
+// be opened.
+class CompressedOfstream : public std::ostream {
+public:
+    CompressedOfstream(const std::string& path, Compression compression, size_t threads);
+    ~CompressedOfstream() override { close(); }
+
+    bool close();
+
+private:
+    std::ofstream file_;
+    std::unique_ptr<CompressingStreamBuf> buffer_;
+};
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "usn_entry_store.h"
+#include "usn_hash.h"
+
+uint32_t StringPool::Intern(UsnStringView str) {
+    if ((size() + 1) * 2 > slots_.size())
+        Rehash(slots_.empty() ? 1024 : slots_.size() * 2);
+
+    uint32_t hash = static_cast<uint32_t>(HashBytes(str.data(), str.size() * sizeof(WCHAR)));
+    size_t mask = slots_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        uint32_t entry = slots_[slot];
+        if (entry == 0) {
+            uint32_t id = static_cast<uint32_t>(size());
+            chars_.insert(chars_.end(), str.begin(), str.end());
+            offsets_.push_back(chars_.size());
+            hashes_.push_back(hash);
+            slots_[slot] = id + 1;
+            return id;
+        }
+        if (hashes_[entry - 1] == hash && Get(entry - 1) == str)
+            return entry - 1;
+    }
+}
+
+void StringPool::Rehash(size_t slotCount) {
+    slots_.assign(slotCount, 0);
+    size_t mask = slotCount - 1;
+    for (uint32_t id = 0; id < hashes_.size(); ++id) {
+        size_t slot = hashes_[id] & mask;
+        while (slots_[slot] != 0)
+            slot = (slot + 1) & mask;
+        slots_[slot] = id + 1;
+    }
+}
+
+size_t StringPool::MemoryUsage() const {
+    return chars_.capacity() * sizeof(WCHAR) + offsets_.capacity() * sizeof(size_t) +
+        hashes_.capacity() * sizeof(uint32_t) + slots_.capacity() * sizeof(uint32_t);
+}
+
+void StringPool::clear() {
+    chars_.clear();
+    offsets_.assign(1, 0);
+    hashes_.clear();
+    slots_.clear();
+}
+
+void UsnEntryStore::reserve(size_t count) {
+    usn_.reserve(count);
+    date_.reserve(count);
+    reason_.reserve(count);
+    wideId_.reserve(count);
+    frn_.reserve(count);
+    parent_.reserve(count);
+    nameId_.reserve(count);
+    dirId_.reserve(count);
+}
+
+void UsnEntryStore::clear() {
+    *this = UsnEntryStore();
+}
+
+FileIdVariant UsnEntryStore::MakeId(const std::vector<ULONGLONG>& low, const std::vector<ULONGLONG>& high, size_t i) const {
+    if (!wideId_[i])
+        return low[i];
+
+    FILE_ID_128 id{};
+    ULONGLONG hi = high.empty() ? 0 : high[i];
+    memcpy(id.Identifier, &low[i], sizeof(ULONGLONG));
+    memcpy(id.Identifier + sizeof(ULONGLONG), &hi, sizeof(ULONGLONG));
+    return id;
+}
+
+void UsnEntryStore::PushId(const FileIdVariant& id, std::vector<ULONGLONG>& low, std::vector<ULONGLONG>& high) {
+    ULONGLONG lo = 0, hi = 0;
+    if (std::holds_alternative<ULONGLONG>(id)) {
+        lo = std::get<ULONGLONG>(id);
+    }
+    else {
+        const auto& id128 = std::get<FILE_ID_128>(id);
+        memcpy(&lo, id128.Identifier, sizeof(ULONGLONG));
+        memcpy(&hi, id128.Identifier + sizeof(ULONGLONG), sizeof(ULONGLONG));
+    }
+
+    if (hi != 0 && high.empty())
+        high.resize(low.size(), 0);
+    low.push_back(lo);
+    if (!high.empty())
+        high.push_back(hi);
+}
+
+void UsnEntryStore::Append(ULONGLONG usn, const FILETIME& date, DWORD reason, const FileIdVariant& fileId,
+    const FileIdVariant& parentId, UsnStringView name, uint32_t directoryId) {
+    usn_.push_back(usn);
+    date_.push_back((static_cast<ULONGLONG>(date.dwHighDateTime) << 32) | date.dwLowDateTime);
+    reason_.push_back(reason);
+    wideId_.push_back(std::holds_alternative<FILE_ID_128>(fileId) ? 1 : 0);
+    PushId(fileId, frn_, frnHigh_);
+    PushId(parentId, parent_, parentHigh_);
+    nameId_.push_back(names_.Intern(name));
+    dirId_.push_back(directoryId);
+}
+
+void UsnEntryStore::Append(UsnEntryStore&& other) {
+    if (other.empty())
+        return;
+
+    if (empty() && names_.size() == 0 && directories_.size() == 0) {
+        *this = std::move(other);
+        return;
+    }
+
+    std::vector<uint32_t> nameMap(other.names_.size());
+    for (uint32_t id = 0; id < nameMap.size(); ++id)
+        nameMap[id] = names_.Intern(other.names_.Get(id));
+
+    std::vector<uint32_t> dirMap(other.directories_.size());
+    for (uint32_t id = 0; id < dirMap.size(); ++id)
+        dirMap[id] = directories_.Intern(other.directories_.Get(id));
+
+    auto appendHigh = [](std::vector<ULONGLONG>& high, const std::vector<ULONGLONG>& otherHigh, size_t oldSize, size_t otherSize) {
+        if (high.empty() && otherHigh.empty())
+            return;
+        high.resize(oldSize, 0);
+        if (otherHigh.empty())
+            high.resize(oldSize + otherSize, 0);
+        else
+            high.insert(high.end(), otherHigh.begin(), otherHigh.end());
+    };
+
+    size_t oldSize = size();
+    size_t otherSize = other.size();
+    usn_.insert(usn_.end(), other.usn_.begin(), other.usn_.end());
+    date_.insert(date_.end(), other.date_.begin(), other.date_.end());
+    reason_.insert(reason_.end(), other.reason_.begin(), other.reason_.end());
+    wideId_.insert(wideId_.end(), other.wideId_.begin(), other.wideId_.end());
+    frn_.insert(frn_.end(), other.frn_.begin(), other.frn_.end());
+    parent_.insert(parent_.end(), other.parent_.begin(), other.parent_.end());
+    appendHigh(frnHigh_, other.frnHigh_, oldSize, otherSize);
+    appendHigh(parentHigh_, other.parentHigh_, oldSize, otherSize);
+
+    nameId_.reserve(oldSize + otherSize);
+    for (uint32_t id : other.nameId_)
+        nameId_.push_back(nameMap[id]);
+    dirId_.reserve(oldSize + otherSize);
+    for (uint32_t id : other.dirId_)
+        dirId_.push_back(id == kPendingDirectory ? id : dirMap[id]);
+
+    other.clear();
+}
+
+void UsnEntryStore::Compact(const std::vector<uint8_t>& keep) {
+    auto compact = [&](auto& column) {
+        if (column.empty())
+            return;
+        size_t kept = 0;
+        for (size_t i = 0; i < keep.size(); ++i)
+            if (keep[i])
+                column[kept++] = column[i];
+        column.resize(kept);
+    };
+
+    compact(usn_);
+    compact(date_);
+    compact(reason_);
+    compact(wideId_);
+    compact(frn_);
+    compact(parent_);
+    compact(frnHigh_);
+    compact(parentHigh_);
+    compact(nameId_);
+    compact(dirId_);
+}
+
+size_t UsnEntryStore::MemoryUsage() const {
+    return usn_.capacity() * sizeof(ULONGLONG) + date_.capacity() * sizeof(ULONGLONG) +
+        reason_.capacity() * sizeof(DWORD) + wideId_.capacity() +
+        (frn_.capacity() + parent_.capacity() + frnHigh_.capacity() + parentHigh_.capacity()) * sizeof(ULONGLONG) +
+        (nameId_.capacity() + dirId_.capacity()) * sizeof(uint32_t) +
+        names_.MemoryUsage() + directories_.MemoryUsage();
+}
\ No newline at end of file
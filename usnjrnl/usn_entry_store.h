@@ -0,0 +1,114 @@
+#pragma once
+
+#include "usn_structs.h"
+#include "usn_file_id.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Deduplicated UTF-16 strings stored back to back in one arena. Ids are dense
+// and stable; equal strings always get the same id.
+class StringPool {
+public:
+    uint32_t Intern(UsnStringView str);
+    UsnStringView Get(uint32_t id) const {
+        return UsnStringView(chars_.data() + offsets_[id], offsets_[id + 1] - offsets_[id]);
+    }
+    size_t size() const { return offsets_.size() - 1; }
+    size_t MemoryUsage() const;
+    void clear();
+
+private:
+    void Rehash(size_t slotCount);
+
+    std::vector<WCHAR> chars_;
+    std::vector<size_t> offsets_{ 0 };
+    std::vector<uint32_t> hashes_;
+    std::vector<uint32_t> slots_;  // id + 1, 0 = empty
+};
+
+// Struct-of-arrays store for accepted journal entries: one fixed-width column
+// per field, names and directories interned into StringPools so each record
+// costs a few dozen bytes. Entries are kept in the order they were appended.
+class UsnEntryStore {
+public:
+    // Directory id of entries whose directory is filled in after parsing.
+    static constexpr uint32_t kPendingDirectory = UINT32_MAX;
+
+    size_t size() const { return usn_.size(); }
+    bool empty() const { return usn_.empty(); }
+    void reserve(size_t count);
+    void clear();
+
+    // Directory id for a parent reference; resolve() is only called the first
+    // time this store sees the reference.
+    template <class Resolve>
+    uint32_t DirectoryFor(const FileIdVariant& parentId, Resolve resolve) {
+        auto it = dirByParent_.find(parentId);
+        if (it != dirByParent_.end())
+            return it->second;
+        uint32_t id = directories_.Intern(resolve());
+        dirByParent_.emplace(parentId, id);
+        return id;
+    }
+    uint32_t InternDirectory(UsnStringView dir) { return directories_.Intern(dir); }
+    UsnStringView DirectoryText(uint32_t directoryId) const { return directories_.Get(directoryId); }
+
+    void Append(ULONGLONG usn, const FILETIME& date, DWORD reason, const FileIdVariant& fileId,
+        const FileIdVariant& parentId, UsnStringView name, uint32_t directoryId);
+
+    void SetDirectory(size_t i, uint32_t directoryId) { dirId_[i] = directoryId; }
+
+    // Drops every entry i for which remove(i) is true, keeping the order.
+    template <class Predicate>
+    void RemoveIf(Predicate remove) {
+        std::vector<uint8_t> keep(size());
+        for (size_t i = 0; i < keep.size(); ++i)
+            keep[i] = remove(i) ? 0 : 1;
+        Compact(keep);
+    }
+
+    // Moves every entry of other to the end of this store, remapping its
+    // name and directory ids.
+    void Append(UsnEntryStore&& other);
+
+    ULONGLONG Usn(size_t i) const { return usn_[i]; }
+    FILETIME Date(size_t i) const {
+        return { static_cast<DWORD>(date_[i]), static_cast<DWORD>(date_[i] >> 32) };
+    }
+    DWORD Reason(size_t i) const { return reason_[i]; }
+    FileIdVariant FileId(size_t i) const { return MakeId(frn_, frnHigh_, i); }
+    FileIdKey FileKey(size_t i) const { return { frn_[i], frnHigh_.empty() ? 0 : frnHigh_[i] }; }
+    FileIdKey ParentKey(size_t i) const { return { parent_[i], parentHigh_.empty() ? 0 : parentHigh_[i] }; }
+    bool WideId(size_t i) const { return wideId_[i] != 0; }
+    FileIdVariant ParentId(size_t i) const { return MakeId(parent_, parentHigh_, i); }
+    uint32_t NameId(size_t i) const { return nameId_[i]; }
+    uint32_t DirectoryId(size_t i) const { return dirId_[i]; }
+    UsnStringView Name(size_t i) const { return names_.Get(nameId_[i]); }
+    UsnStringView Directory(size_t i) const { return directories_.Get(dirId_[i]); }
+
+    const StringPool& Names() const { return names_; }
+    const StringPool& Directories() const { return directories_; }
+
+    size_t MemoryUsage() const;
+
+private:
+    void Compact(const std::vector<uint8_t>& keep);
+    FileIdVariant MakeId(const std::vector<ULONGLONG>& low, const std::vector<ULONGLONG>& high, size_t i) const;
+    static void PushId(const FileIdVariant& id, std::vector<ULONGLONG>& low, std::vector<ULONGLONG>& high);
+
+    std::vector<ULONGLONG> usn_;
+    std::vector<ULONGLONG> date_;
+    std::vector<DWORD> reason_;
+    std::vector<uint8_t> wideId_;  // 1 when the record carried FILE_ID_128 references
+    std::vector<ULONGLONG> frn_;
+    std::vector<ULONGLONG> parent_;
+    std::vector<ULONGLONG> frnHigh_;     // only allocated once an id needs more than 64 bits
+    std::vector<ULONGLONG> parentHigh_;
+    std::vector<uint32_t> nameId_;
+    std::vector<uint32_t> dirId_;
+
+    StringPool names_;
+    StringPool directories_;
+    std::unordered_map<FileIdVariant, uint32_t, FileIdHash, FileIdEqual> dirByParent_;
+};
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "usn_file_id.h"
+#include <charconv>
+
+namespace {
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+void WriteHex64(char* out, ULONGLONG value) {
+    for (int i = 15; i >= 0; --i) {
+        out[i] = kHexDigits[value & 0xF];
+        value >>= 4;
+    }
+}
+
+}
+
+std::string FormatFileId(const FileIdVariant& id) {
+    char buffer[kMaxFileIdText];
+    char* end = WriteFileId(buffer, MakeFileIdKey(id), !std::holds_alternative<ULONGLONG>(id));
+    return std::string(buffer, end);
+}
+
+char* WriteFileId(char* out, FileIdKey key, bool wide) {
+    if (!wide)
+        return std::to_chars(out, out + kMaxFileIdText, key.low).ptr;
+
+    out[0] = '0';
+    out[1] = 'x';
+    WriteHex64(out + 2, key.high);
+    WriteHex64(out + 18, key.low);
+    return out + kMaxFileIdText;
+}
+
+bool ParseFileId(std::string_view text, FileIdKey& key) {
+    key = {};
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        std::string_view digits = text.substr(2);
+        if (digits.size() > 32)
+            return false;
+        for (char c : digits) {
+            int value = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            if (value < 0)
+                return false;
+            key.high = (key.high << 4) | (key.low >> 60);
+            key.low = (key.low << 4) | value;
+        }
+        return true;
+    }
+
+    auto result = std::from_chars(text.data(), text.data() + text.size(), key.low);
+    return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+void FileIdSet::Insert(FileIdKey key) {
+    if ((count_ + 1) * 2 > slots_.size())
+        Rehash(slots_.empty() ? 16 : slots_.size() * 2);
+
+    for (size_t slot = HashFileIdKey(key) & mask_;; slot = (slot + 1) & mask_) {
+        if (!used_[slot]) {
+            slots_[slot] = key;
+            used_[slot] = 1;
+            ++count_;
+            return;
+        }
+        if (slots_[slot] == key)
+            return;
+    }
+}
+
+void FileIdSet::Rehash(size_t slotCount) {
+    std::vector<FileIdKey> oldSlots = std::move(slots_);
+    std::vector<uint8_t> oldUsed = std::move(used_);
+    slots_.assign(slotCount, {});
+    used_.assign(slotCount, 0);
+    mask_ = slotCount - 1;
+    count_ = 0;
+    for (size_t i = 0; i < oldSlots.size(); ++i)
+        if (oldUsed[i])
+            Insert(oldSlots[i]);
+}
+
+void FileIdSet::clear() {
+    slots_.clear();
+    used_.clear();
+    mask_ = 0;
+    count_ = 0;
+}
+
+uint32_t FileIdIndex::Intern(FileIdKey key) {
+    if ((size() + 1) * 2 > slots_.size())
+        Rehash(slots_.empty() ? 1024 : slots_.size() * 2);
+
+    size_t mask = slots_.size() - 1;
+    for (size_t slot = HashFileIdKey(key) & mask;; slot = (slot + 1) & mask) {
+        uint32_t entry = slots_[slot];
+        if (entry == 0) {
+            keys_.push_back(key);
+            slots_[slot] = static_cast<uint32_t>(keys_.size());
+            return static_cast<uint32_t>(keys_.size() - 1);
+        }
+        if (keys_[entry - 1] == key)
+            return entry - 1;
+    }
+}
+
+void FileIdIndex::Rehash(size_t slotCount) {
+    slots_.assign(slotCount, 0);
+    size_t mask = slotCount - 1;
+    for (uint32_t id = 0; id < keys_.size(); ++id) {
+        size_t slot = HashFileIdKey(keys_[id]) & mask;
+        while (slots_[slot] != 0)
+            slot = (slot + 1) & mask;
+        slots_[slot] = id + 1;
+    }
+}
+
+void FileIdIndex::clear() {
+    keys_.clear();
+    slots_.clear();
+}
\ No newline at end of file
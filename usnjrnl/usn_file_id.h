@@ -0,0 +1,112 @@
+#pragma once
+
+#include "usn_structs.h"
+#include "usn_hash.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A file reference as two 64-bit halves. A 64-bit FRN and a FILE_ID_128 with
+// the same value (NTFS zeroes the upper half) give the same key.
+struct FileIdKey {
+    ULONGLONG low = 0;
+    ULONGLONG high = 0;
+
+    bool operator==(const FileIdKey& other) const { return low == other.low && high == other.high; }
+};
+
+inline FileIdKey MakeFileIdKey(const FileIdVariant& id) {
+    FileIdKey key;
+    if (std::holds_alternative<ULONGLONG>(id)) {
+        key.low = std::get<ULONGLONG>(id);
+    }
+    else {
+        const auto& id128 = std::get<FILE_ID_128>(id);
+        memcpy(&key.low, id128.Identifier, sizeof(ULONGLONG));
+        memcpy(&key.high, id128.Identifier + sizeof(ULONGLONG), sizeof(ULONGLONG));
+    }
+    return key;
+}
+
+inline FileIdVariant MakeFileIdVariant(FileIdKey key, bool wide) {
+    if (!wide)
+        return key.low;
+    FILE_ID_128 id{};
+    memcpy(id.Identifier, &key.low, sizeof(ULONGLONG));
+    memcpy(id.Identifier + sizeof(ULONGLONG), &key.high, sizeof(ULONGLONG));
+    return id;
+}
+
+inline size_t HashFileIdKey(FileIdKey key) {
+    return static_cast<size_t>(MixHash64(key.low ^ MixHash64(key.high)));
+}
+
+struct FileIdKeyHash {
+    size_t operator()(FileIdKey key) const { return HashFileIdKey(key); }
+};
+
+// The MFT segment alone, without the sequence number in the top 16 bits.
+inline FileIdKey SegmentOf(FileIdKey key) {
+    key.low &= 0x0000FFFFFFFFFFFFULL;
+    return key;
+}
+
+// 64-bit ids print in decimal, 128-bit ids as 0x and 32 hex digits (the way
+// fsutil shows them).
+std::string FormatFileId(const FileIdVariant& id);
+
+// Writes the same text to out, which needs kMaxFileIdText chars, and returns
+// its end.
+inline constexpr size_t kMaxFileIdText = 34;
+char* WriteFileId(char* out, FileIdKey key, bool wide);
+
+// Accepts the forms FormatFileId writes: decimal, or 0x and up to 32 hex digits.
+bool ParseFileId(std::string_view text, FileIdKey& key);
+
+// Open-addressing set of file ids for the -i filter.
+class FileIdSet {
+public:
+    void Insert(FileIdKey key);
+    bool Contains(FileIdKey key) const {
+        if (count_ == 0)
+            return false;
+        for (size_t slot = HashFileIdKey(key) & mask_;; slot = (slot + 1) & mask_) {
+            if (!used_[slot])
+                return false;
+            if (slots_[slot] == key)
+                return true;
+        }
+    }
+    size_t size() const { return count_; }
+    void clear();
+
+    template <class Visit>
+    void ForEach(Visit visit) const {
+        for (size_t slot = 0; slot < slots_.size(); ++slot)
+            if (used_[slot])
+                visit(slots_[slot]);
+    }
+
+private:
+    void Rehash(size_t slotCount);
+
+    std::vector<FileIdKey> slots_;
+    std::vector<uint8_t> used_;
+    size_t mask_ = 0;
+    size_t count_ = 0;
+};
+
+// Dense ids for file ids, in the order they are first seen.
+class FileIdIndex {
+public:
+    uint32_t Intern(FileIdKey key);
+    size_t size() const { return keys_.size(); }
+    void clear();
+
+private:
+    void Rehash(size_t slotCount);
+
+    std::vector<FileIdKey> keys_;
+    std::vector<uint32_t> slots_;  // id + 1, 0 = empty
+};
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+
+// Record filters run as ordered stages, cheapest first: the raw header fields,
+// then the decoded name, then the resolved directory. A record is counted
+// against the first stage that rejects it.
+enum FilterStage : size_t {
+    kStageTime,
+    kStageReason,
+    kStageFileId,
+    kStageName,
+    kStagePath,
+    kStageCount,
+    kStageAccepted = kStageCount
+};
+
+inline const char* FilterStageName(FilterStage stage) {
+    switch (stage) {
+    case kStageTime: return "time";
+    case kStageReason: return "reason";
+    case kStageFileId: return "file id";
+    case kStageName: return "name";
+    case kStagePath: return "path";
+    default: return "?";
+    }
+}
+
+struct FilterCounters {
+    size_t rejected[kStageCount] = {};
+
+    size_t Total() const {
+        size_t total = 0;
+        for (size_t count : rejected)
+            total += count;
+        return total;
+    }
+
+    FilterCounters& operator+=(const FilterCounters& other) {
+        for (size_t i = 0; i < kStageCount; ++i)
+            rejected[i] += other.rejected[i];
+        return *this;
+    }
+};
\ No newline at end of file
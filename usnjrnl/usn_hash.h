@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Small non-cryptographic hashes for the in-memory tables (string pools, file
+// ID sets). Not stable across versions, never persist them.
+
+inline uint64_t MixHash64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline uint64_t HashBytes(const void* data, size_t size) {
+    const auto* p = static_cast<const unsigned char*>(data);
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ (size * 0x100000001b3ULL);
+
+    while (size >= 8) {
+        uint64_t block;
+        memcpy(&block, p, 8);
+        h = (h ^ MixHash64(block)) * 0x100000001b3ULL;
+        p += 8;
+        size -= 8;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, p, size);
+    return MixHash64(h ^ tail);
+}
\ No newline at end of file
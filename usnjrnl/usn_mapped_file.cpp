@@ -0,0 +1,140 @@
+#include "usn_mapped_file.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+
+#ifdef _WIN32
+    fileHandle_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle_ == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(fileHandle_, &fileSize)) {
+        Close();
+        return false;
+    }
+    if (fileSize.QuadPart == 0)
+        return true;
+
+    mappingHandle_ = CreateFileMappingW(fileHandle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mappingHandle_) {
+        Close();
+        return false;
+    }
+
+    data_ = static_cast<const BYTE*>(MapViewOfFile(mappingHandle_, FILE_MAP_READ, 0, 0, 0));
+    if (!data_) {
+        Close();
+        return false;
+    }
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+#else
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0)
+        return false;
+
+    struct stat st{};
+    if (fstat(fd_, &st) != 0) {
+        Close();
+        return false;
+    }
+    if (st.st_size == 0)
+        return true;
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    madvise(mapping, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    data_ = static_cast<const BYTE*>(mapping);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+
+    return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+    if (data_) UnmapViewOfFile(data_);
+    if (mappingHandle_) CloseHandle(mappingHandle_);
+    if (fileHandle_ != INVALID_HANDLE_VALUE) CloseHandle(fileHandle_);
+    mappingHandle_ = nullptr;
+    fileHandle_ = INVALID_HANDLE_VALUE;
+#else
+    if (data_) munmap(const_cast<BYTE*>(data_), size_);
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+std::vector<std::pair<size_t, size_t>> MappedFile::DataRanges() const {
+    std::vector<std::pair<size_t, size_t>> ranges;
+    if (size_ == 0)
+        return ranges;
+
+#ifdef _WIN32
+    BY_HANDLE_FILE_INFORMATION info{};
+    if (!GetFileInformationByHandle(fileHandle_, &info) || !(info.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE))
+        return { { 0, size_ } };
+
+    FILE_ALLOCATED_RANGE_BUFFER query{};
+    query.FileOffset.QuadPart = 0;
+    query.Length.QuadPart = static_cast<LONGLONG>(size_);
+
+    FILE_ALLOCATED_RANGE_BUFFER result[64];
+    for (;;) {
+        DWORD bytesReturned = 0;
+        BOOL ok = DeviceIoControl(fileHandle_, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query),
+            result, sizeof(result), &bytesReturned, nullptr);
+        if (!ok && GetLastError() != ERROR_MORE_DATA)
+            return { { 0, size_ } };
+
+        DWORD count = bytesReturned / sizeof(FILE_ALLOCATED_RANGE_BUFFER);
+        for (DWORD i = 0; i < count; ++i)
+            ranges.emplace_back(static_cast<size_t>(result[i].FileOffset.QuadPart), static_cast<size_t>(result[i].Length.QuadPart));
+
+        if (ok || count == 0)
+            break;
+
+        LONGLONG next = result[count - 1].FileOffset.QuadPart + result[count - 1].Length.QuadPart;
+        query.Length.QuadPart = static_cast<LONGLONG>(size_) - next;
+        query.FileOffset.QuadPart = next;
+    }
+#else
+    struct stat st{};
+    if (fstat(fd_, &st) != 0 || static_cast<off_t>(st.st_blocks) * 512 >= st.st_size)
+        return { { 0, size_ } };
+
+    off_t pos = 0;
+    while (static_cast<size_t>(pos) < size_) {
+        off_t dataStart = lseek(fd_, pos, SEEK_DATA);
+        if (dataStart < 0) {
+            if (errno != ENXIO && ranges.empty())
+                return { { 0, size_ } };  // SEEK_DATA not supported by this filesystem
+            break;
+        }
+        off_t holeStart = lseek(fd_, dataStart, SEEK_HOLE);
+        if (holeStart < 0 || static_cast<size_t>(holeStart) > size_)
+            holeStart = static_cast<off_t>(size_);
+        ranges.emplace_back(static_cast<size_t>(dataStart), static_cast<size_t>(holeStart - dataStart));
+        pos = holeStart;
+    }
+#endif
+
+    return ranges;
+}
\ No newline at end of file
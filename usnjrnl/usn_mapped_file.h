@@ -0,0 +1,35 @@
+#pragma once
+
+#include "usn_platform.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+// Read-only memory mapping of a whole file (an extracted $UsnJrnl:$J stream).
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    const BYTE* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Allocated (offset, length) ranges of a sparse file; a single range covering
+    // the whole file when it isn't sparse or the filesystem can't tell.
+    std::vector<std::pair<size_t, size_t>> DataRanges() const;
+
+private:
+    const BYTE* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE fileHandle_ = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
\ No newline at end of file
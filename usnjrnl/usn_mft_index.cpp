@@ -0,0 +1,202 @@
+#include "usn_mft_index.h"
+#include "usn_mapped_file.h"
+#include <algorithm>
+#include <cstddef>
+
+static_assert(offsetof(MFT_RECORD_HEADER, BaseRecord) == 0x20, "MFT record header layout");
+static_assert(offsetof(MFT_ATTRIBUTE_HEADER, ValueOffset) == 0x14, "MFT attribute header layout");
+static_assert(offsetof(MFT_FILE_NAME, Name) == 0x42, "$FILE_NAME layout");
+
+namespace {
+
+constexpr DWORD kFileSignature = 0x454C4946;  // "FILE"
+constexpr DWORD kFileNameAttribute = 0x30;
+constexpr DWORD kEndOfAttributes = 0xFFFFFFFF;
+constexpr BYTE kDosNameSpace = 2;
+constexpr size_t kRecordsPerChunk = 64 * 1024;
+
+size_t RecordNumber(ULONGLONG reference) {
+    return static_cast<size_t>(reference & 0x0000FFFFFFFFFFFFULL);
+}
+
+}
+
+bool MftIndex::Open(const std::string& path, ThreadPool& pool) {
+    MappedFile file;
+    if (!file.Open(path) || file.size() < sizeof(MFT_RECORD_HEADER))
+        return false;
+
+    // $MFT describes itself in record 0, including the record size in use
+    auto first = reinterpret_cast<const MFT_RECORD_HEADER*>(file.data());
+    recordSize_ = first->BytesAllocated;
+    if (first->Signature != kFileSignature || recordSize_ < 512 || recordSize_ > 65536 ||
+        (recordSize_ & (recordSize_ - 1)) != 0)
+        return false;
+
+    size_t count = file.size() / recordSize_;
+    records_.assign(count, {});
+    names_.clear();
+
+    struct Chunk {
+        std::vector<WCHAR> names;
+        std::vector<Extension> extensions;
+    };
+    size_t chunkCount = std::max<size_t>(1, std::min((count + kRecordsPerChunk - 1) / kRecordsPerChunk, pool.size() * 4));
+    size_t perChunk = (count + chunkCount - 1) / chunkCount;
+    std::vector<Chunk> chunks(chunkCount);
+
+    pool.ParallelFor(chunkCount, [&](size_t c) {
+        std::vector<BYTE> scratch(recordSize_);
+        Chunk& chunk = chunks[c];
+        size_t last = std::min(count, (c + 1) * perChunk);
+        for (size_t i = c * perChunk; i < last; ++i) {
+            Record record;
+            ULONGLONG base = 0;
+            if (!ParseRecord(file.data() + i * recordSize_, recordSize_, scratch.data(), record, base, chunk.names))
+                continue;
+            if (base == 0)
+                records_[i] = record;
+            else if (record.flags & kNamed)
+                chunk.extensions.push_back({ RecordNumber(base), record });
+        }
+    });
+
+    // Name offsets are chunk-relative until the arenas are joined
+    std::vector<Extension> extensions;
+    for (size_t c = 0; c < chunkCount; ++c) {
+        uint32_t offset = static_cast<uint32_t>(names_.size());
+        names_.insert(names_.end(), chunks[c].names.begin(), chunks[c].names.end());
+
+        size_t last = std::min(count, (c + 1) * perChunk);
+        for (size_t i = c * perChunk; i < last; ++i)
+            if (records_[i].flags & kNamed)
+                records_[i].nameOffset += offset;
+        for (auto& extension : chunks[c].extensions) {
+            extension.record.nameOffset += offset;
+            extensions.push_back(extension);
+        }
+    }
+
+    // A $FILE_NAME that spilled into an extension record names its base record
+    for (const auto& extension : extensions) {
+        if (extension.base >= count)
+            continue;
+        Record& base = records_[extension.base];
+        if ((base.flags & kNamed) && !(base.nameSpace == kDosNameSpace && extension.record.nameSpace != kDosNameSpace))
+            continue;
+        base.parent = extension.record.parent;
+        base.nameOffset = extension.record.nameOffset;
+        base.nameLength = extension.record.nameLength;
+        base.nameSpace = extension.record.nameSpace;
+        base.flags |= kNamed;
+    }
+
+    return true;
+}
+
+// Copies one record slot into scratch, applies its update sequence fixups and
+// picks the $FILE_NAME to index: the long name when there is also a DOS one.
+// Fails only for slots that don't hold an intact FILE record.
+bool MftIndex::ParseRecord(const BYTE* slot, size_t recordSize, BYTE* scratch,
+    Record& record, ULONGLONG& baseRecord, std::vector<WCHAR>& names) {
+    auto header = reinterpret_cast<const MFT_RECORD_HEADER*>(slot);
+    if (header->Signature != kFileSignature)
+        return false;
+
+    size_t usaOffset = header->UpdateSequenceOffset;
+    size_t usaCount = header->UpdateSequenceCount;
+    if (usaCount < 2 || usaOffset + usaCount * sizeof(WORD) > recordSize || recordSize % (usaCount - 1) != 0)
+        return false;
+
+    memcpy(scratch, slot, recordSize);
+    size_t stride = recordSize / (usaCount - 1);
+    const BYTE* usa = slot + usaOffset;
+    for (size_t s = 1; s < usaCount; ++s) {
+        BYTE* tail = scratch + s * stride - sizeof(WORD);
+        if (memcmp(tail, usa, sizeof(WORD)) != 0)
+            return false;  // torn write
+        memcpy(tail, usa + s * sizeof(WORD), sizeof(WORD));
+    }
+
+    header = reinterpret_cast<const MFT_RECORD_HEADER*>(scratch);
+    record.sequence = header->SequenceNumber;
+    record.flags = (header->Flags & 0x01 ? kInUse : 0) | (header->Flags & 0x02 ? kDirectory : 0);
+    baseRecord = header->BaseRecord;
+
+    size_t used = std::min<size_t>(header->BytesInUse, recordSize);
+    size_t offset = header->FirstAttributeOffset;
+    while (offset + sizeof(MFT_ATTRIBUTE_HEADER) <= used) {
+        auto attribute = reinterpret_cast<const MFT_ATTRIBUTE_HEADER*>(scratch + offset);
+        if (attribute->Type == kEndOfAttributes || attribute->Length < sizeof(MFT_ATTRIBUTE_HEADER) ||
+            attribute->Length > used - offset)
+            break;
+
+        if (attribute->Type == kFileNameAttribute && !attribute->NonResident &&
+            attribute->ValueLength >= offsetof(MFT_FILE_NAME, Name) &&
+            (size_t)attribute->ValueOffset + attribute->ValueLength <= attribute->Length) {
+            auto fileName = reinterpret_cast<const MFT_FILE_NAME*>(scratch + offset + attribute->ValueOffset);
+            size_t nameBytes = fileName->NameLength * sizeof(WCHAR);
+            bool better = !(record.flags & kNamed) ||
+                (record.nameSpace == kDosNameSpace && fileName->NameSpace != kDosNameSpace);
+            if (better && offsetof(MFT_FILE_NAME, Name) + nameBytes <= attribute->ValueLength) {
+                record.parent = fileName->ParentReference;
+                record.nameOffset = static_cast<uint32_t>(names.size());
+                record.nameLength = fileName->NameLength;
+                record.nameSpace = fileName->NameSpace;
+                record.flags |= kNamed;
+                names.resize(names.size() + fileName->NameLength);
+                memcpy(names.data() + record.nameOffset, fileName->Name, nameBytes);
+            }
+        }
+        offset += attribute->Length;
+    }
+
+    return true;
+}
+
+// A parent reference still points at a directory record when the sequence
+// numbers agree. NTFS bumps the sequence number when it frees a record, so a
+// deleted directory whose slot hasn't been reused yet is one ahead.
+bool MftIndex::Matches(size_t index, ULONGLONG reference) const {
+    const Record& record = records_[index];
+    if ((record.flags & (kNamed | kDirectory)) != (kNamed | kDirectory))
+        return false;
+
+    WORD sequence = static_cast<WORD>(reference >> 48);
+    if (sequence == 0 || record.sequence == sequence)
+        return true;
+    return !(record.flags & kInUse) && record.sequence == static_cast<WORD>(sequence + 1);
+}
+
+bool MftIndex::Lookup(const FileIdVariant& reference, FileIdVariant& parent, UsnStringView& name) const {
+    ULONGLONG frn = 0;
+    bool wide = !std::holds_alternative<ULONGLONG>(reference);
+    if (!wide) {
+        frn = std::get<ULONGLONG>(reference);
+    }
+    else {
+        // NTFS hands out 128-bit ids with the upper half zeroed
+        const auto& id128 = std::get<FILE_ID_128>(reference);
+        ULONGLONG high = 0;
+        memcpy(&frn, id128.Identifier, sizeof(ULONGLONG));
+        memcpy(&high, id128.Identifier + sizeof(ULONGLONG), sizeof(ULONGLONG));
+        if (high != 0)
+            return false;
+    }
+
+    size_t index = RecordNumber(frn);
+    if (index >= records_.size() || !Matches(index, frn))
+        return false;
+
+    const Record& record = records_[index];
+    if (wide) {
+        FILE_ID_128 parent128{};
+        memcpy(parent128.Identifier, &record.parent, sizeof(ULONGLONG));
+        parent = parent128;
+    }
+    else {
+        parent = record.parent;
+    }
+    name = Name(record);
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "usn_structs.h"
+#include "usn_thread_pool.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk layout of the parts of an NTFS FILE record that the index reads.
+#pragma pack(push, 1)
+struct MFT_RECORD_HEADER {
+    DWORD Signature;             // "FILE"
+    WORD UpdateSequenceOffset;
+    WORD UpdateSequenceCount;    // in words, including the sequence number itself
+    ULONGLONG LogFileSequenceNumber;
+    WORD SequenceNumber;
+    WORD LinkCount;
+    WORD FirstAttributeOffset;
+    WORD Flags;                  // 0x01 in use, 0x02 directory
+    DWORD BytesInUse;
+    DWORD BytesAllocated;
+    ULONGLONG BaseRecord;        // non-zero for extension records
+    WORD NextAttributeId;
+};
+
+struct MFT_ATTRIBUTE_HEADER {
+    DWORD Type;
+    DWORD Length;
+    BYTE NonResident;
+    BYTE NameLength;
+    WORD NameOffset;
+    WORD Flags;
+    WORD AttributeId;
+    DWORD ValueLength;           // resident attributes only
+    WORD ValueOffset;
+};
+
+struct MFT_FILE_NAME {
+    ULONGLONG ParentReference;
+    ULONGLONG CreationTime;
+    ULONGLONG ModificationTime;
+    ULONGLONG MftModificationTime;
+    ULONGLONG AccessTime;
+    ULONGLONG AllocatedSize;
+    ULONGLONG DataSize;
+    DWORD FileAttributes;
+    DWORD Reparse;
+    BYTE NameLength;             // in characters
+    BYTE NameSpace;              // 0 POSIX, 1 Win32, 2 DOS, 3 Win32 & DOS
+    WCHAR Name[1];
+};
+#pragma pack(pop)
+
+// Parent reference, name and sequence number of every record of a raw $MFT,
+// used to name directories the journal itself never mentions.
+class MftIndex {
+public:
+    // Maps the file and indexes every record slot on the pool.
+    bool Open(const std::string& path, ThreadPool& pool);
+
+    size_t size() const { return records_.size(); }
+    size_t RecordSize() const { return recordSize_; }
+
+    // Parent and name of the directory a file reference points to. Fails when
+    // the record was reused or never held a name. The parent comes back in the
+    // same id form as the reference.
+    bool Lookup(const FileIdVariant& reference, FileIdVariant& parent, UsnStringView& name) const;
+
+private:
+    enum : uint8_t { kInUse = 0x01, kDirectory = 0x02, kNamed = 0x04 };
+
+    struct Record {
+        ULONGLONG parent = 0;
+        uint32_t nameOffset = 0;
+        uint16_t nameLength = 0;
+        uint16_t sequence = 0;
+        uint8_t flags = 0;
+        uint8_t nameSpace = 0;
+    };
+
+    struct Extension {
+        size_t base;
+        Record record;
+    };
+
+    static bool ParseRecord(const BYTE* slot, size_t recordSize, BYTE* scratch,
+        Record& record, ULONGLONG& baseRecord, std::vector<WCHAR>& names);
+    bool Matches(size_t index, ULONGLONG reference) const;
+    UsnStringView Name(const Record& record) const {
+        return UsnStringView(names_.data() + record.nameOffset, record.nameLength);
+    }
+
+    size_t recordSize_ = 0;
+    std::vector<Record> records_;
+    std::vector<WCHAR> names_;
+};
\ No newline at end of file
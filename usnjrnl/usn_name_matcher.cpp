@@ -0,0 +1,217 @@
+#include "usn_name_matcher.h"
+#include "usn_utils.h"
+#include <algorithm>
+
+WCHAR FoldCase(WCHAR c) {
+    if (c < 0x80)
+        return (c >= 'A' && c <= 'Z') ? WCHAR(c + 0x20) : c;
+    if (c >= 0xC0 && c <= 0xDE && c != 0xD7)
+        return WCHAR(c + 0x20);
+    if (c >= 0x391 && c <= 0x3AB && c != 0x3A2)
+        return WCHAR(c + 0x20);
+    if (c >= 0x410 && c <= 0x42F)
+        return WCHAR(c + 0x20);
+    if (c >= 0x400 && c <= 0x40F)
+        return WCHAR(c + 0x50);
+    return c;
+}
+
+namespace {
+
+constexpr uint8_t kAcceptLiteral = 0x01;
+constexpr uint8_t kCheckGlobs = 0x02;
+
+bool IsWildcard(WCHAR c) {
+    return c == USN_TEXT('*') || c == USN_TEXT('?');
+}
+
+}
+
+void NameMatcher::Compile(const std::vector<std::string>& tokens, bool ignoreCase) {
+    *this = NameMatcher();
+    ignoreCase_ = ignoreCase;
+    classOf_ = std::make_unique<uint16_t[]>(0x10000);
+
+    for (const auto& token : tokens) {
+        UsnString pattern = from_utf8(token);
+        for (auto& c : pattern)
+            c = Fold(c);
+
+        // an empty token used to be found in every name, and still is
+        if (pattern.empty()) {
+            matchAll_ = true;
+            continue;
+        }
+
+        if (std::none_of(pattern.begin(), pattern.end(), IsWildcard)) {
+            AddPattern(pattern, -1);
+            continue;
+        }
+
+        size_t bestStart = 0, bestLength = 0;
+        for (size_t i = 0; i < pattern.size();) {
+            if (IsWildcard(pattern[i])) {
+                ++i;
+                continue;
+            }
+            size_t start = i;
+            while (i < pattern.size() && !IsWildcard(pattern[i]))
+                ++i;
+            if (i - start > bestLength) {
+                bestStart = start;
+                bestLength = i - start;
+            }
+        }
+
+        int32_t id = static_cast<int32_t>(globs_.size());
+        globs_.push_back(pattern);
+        if (bestLength == 0)
+            unanchored_.push_back(id);
+        else
+            AddPattern(pattern.substr(bestStart, bestLength), id);
+    }
+
+    if (states_ > 0)
+        Build();
+}
+
+void NameMatcher::AddPattern(const UsnString& literal, int32_t glob) {
+    if (states_ == 0) {
+        edges_.emplace_back();
+        accept_.push_back(0);
+        globsAt_.emplace_back();
+        states_ = 1;
+    }
+
+    int32_t state = 0;
+    for (WCHAR c : literal) {
+        uint16_t& cls = classOf_[static_cast<uint16_t>(c)];
+        if (cls == 0)
+            cls = static_cast<uint16_t>(classes_++);
+
+        auto& edges = edges_[state];
+        auto it = std::find_if(edges.begin(), edges.end(), [&](const auto& e) { return e.first == cls; });
+        if (it != edges.end()) {
+            state = it->second;
+            continue;
+        }
+
+        int32_t child = static_cast<int32_t>(states_++);
+        edges.push_back({ cls, child });
+        edges_.emplace_back();
+        accept_.push_back(0);
+        globsAt_.emplace_back();
+        state = child;
+    }
+
+    if (glob < 0) {
+        accept_[state] |= kAcceptLiteral;
+    }
+    else {
+        accept_[state] |= kCheckGlobs;
+        globsAt_[state].push_back(static_cast<uint32_t>(glob));
+    }
+}
+
+// Turns the trie into a complete transition table: a missing edge goes where
+// the failure link's edge goes, and each state inherits the outputs of the
+// states its failure chain passes through.
+void NameMatcher::Build() {
+    const size_t C = classes_;
+    next_.assign(states_ * C, -1);
+    for (size_t s = 0; s < states_; ++s)
+        for (const auto& [cls, child] : edges_[s])
+            next_[s * C + cls] = child;
+    edges_.clear();
+    edges_.shrink_to_fit();
+
+    std::vector<int32_t> fail(states_, 0);
+    std::vector<int32_t> queue;
+    queue.reserve(states_);
+    for (size_t c = 0; c < C; ++c) {
+        int32_t& target = next_[c];
+        if (target < 0)
+            target = 0;
+        else
+            queue.push_back(target);
+    }
+
+    for (size_t head = 0; head < queue.size(); ++head) {
+        int32_t state = queue[head];
+        for (size_t c = 0; c < C; ++c) {
+            int32_t& target = next_[state * C + c];
+            int32_t viaFail = next_[fail[state] * C + c];
+            if (target < 0) {
+                target = viaFail;
+                continue;
+            }
+            fail[target] = viaFail;
+            accept_[target] |= accept_[viaFail];
+            const auto& inherited = globsAt_[viaFail];
+            globsAt_[target].insert(globsAt_[target].end(), inherited.begin(), inherited.end());
+            queue.push_back(target);
+        }
+    }
+
+    // Units that only differ in case share a class, so names need no folding
+    if (ignoreCase_) {
+        for (uint32_t c = 0; c < 0x10000; ++c) {
+            uint16_t folded = classOf_[static_cast<uint16_t>(FoldCase(static_cast<WCHAR>(c)))];
+            if (classOf_[c] == 0 && folded != 0)
+                classOf_[c] = folded;
+        }
+    }
+}
+
+bool NameMatcher::Matches(UsnStringView name) const {
+    if (matchAll_)
+        return true;
+    for (uint32_t id : unanchored_)
+        if (GlobMatches(globs_[id], name))
+            return true;
+    if (states_ == 0)
+        return false;
+
+    const size_t C = classes_;
+    int32_t state = 0;
+    for (WCHAR c : name) {
+        state = next_[state * C + classOf_[static_cast<uint16_t>(c)]];
+        uint8_t flags = accept_[state];
+        if (flags == 0)
+            continue;
+        if (flags & kAcceptLiteral)
+            return true;
+        for (uint32_t id : globsAt_[state])
+            if (GlobMatches(globs_[id], name))
+                return true;
+    }
+    return false;
+}
+
+// Whole-name wildcard match: * is any run of code units, ? exactly one.
+bool NameMatcher::GlobMatches(const UsnString& pattern, UsnStringView name) const {
+    size_t p = 0, n = 0;
+    size_t star = UsnString::npos, mark = 0;
+
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == USN_TEXT('?') || pattern[p] == Fold(name[n]))) {
+            ++p;
+            ++n;
+        }
+        else if (p < pattern.size() && pattern[p] == USN_TEXT('*')) {
+            star = p++;
+            mark = n;
+        }
+        else if (star != UsnString::npos) {
+            p = star + 1;
+            n = ++mark;
+        }
+        else {
+            return false;
+        }
+    }
+
+    while (p < pattern.size() && pattern[p] == USN_TEXT('*'))
+        ++p;
+    return p == pattern.size();
+}
\ No newline at end of file
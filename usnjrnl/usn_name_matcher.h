@@ -0,0 +1,44 @@
+#pragma once
+
+#include "usn_structs.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Folds one UTF-16 code unit for case-insensitive matching: ASCII, Latin-1,
+// Greek and Cyrillic capitals map to their small letters, the rest is kept.
+WCHAR FoldCase(WCHAR c);
+
+// Matches file names against a whole -n watchlist in one pass over the
+// record's UTF-16 name. Plain tokens keep their substring meaning; tokens
+// with * or ? are globs over the whole name. Every plain token and the
+// longest literal run of every glob go into one Aho-Corasick automaton, so
+// the cost per name doesn't grow with the list. A glob is only checked in
+// full when its literal run shows up.
+class NameMatcher {
+public:
+    void Compile(const std::vector<std::string>& tokens, bool ignoreCase);
+
+    bool Matches(UsnStringView name) const;
+
+private:
+    WCHAR Fold(WCHAR c) const { return ignoreCase_ ? FoldCase(c) : c; }
+    bool GlobMatches(const UsnString& pattern, UsnStringView name) const;
+    void AddPattern(const UsnString& literal, int32_t glob);
+    void Build();
+
+    bool ignoreCase_ = false;
+    bool matchAll_ = false;
+    std::unique_ptr<uint16_t[]> classOf_;   // code unit -> symbol class, 0 for units no pattern uses
+    size_t classes_ = 1;
+    size_t states_ = 0;
+    std::vector<int32_t> next_;             // states_ x classes_, complete after Build
+    std::vector<uint8_t> accept_;           // a plain token ends here or at a suffix state
+    std::vector<std::vector<uint32_t>> globsAt_;
+    std::vector<UsnString> globs_;
+    std::vector<uint32_t> unanchored_;      // globs without any literal, checked on every name
+
+    // trie under construction
+    std::vector<std::vector<std::pair<uint16_t, int32_t>>> edges_;
+};
\ No newline at end of file
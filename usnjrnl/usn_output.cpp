@@ -0,0 +1,226 @@
+#include "usn_output.h"
+#include "usn_utils.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define USN_JSON_SSE2 1
+#endif
+
+namespace {
+
+constexpr ULONGLONG kTicksPerSecond = 10000000ULL;
+constexpr ULONGLONG kTicksPerDay = 86400 * kTicksPerSecond;
+
+bool NeedsJsonEscape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+// The escape for c, which NeedsJsonEscape; returns its length.
+size_t JsonEscapeChar(unsigned char c, char* out) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    out[0] = '\\';
+    switch (c) {
+    case '"': out[1] = '"'; return 2;
+    case '\\': out[1] = '\\'; return 2;
+    case '\b': out[1] = 'b'; return 2;
+    case '\f': out[1] = 'f'; return 2;
+    case '\n': out[1] = 'n'; return 2;
+    case '\r': out[1] = 'r'; return 2;
+    case '\t': out[1] = 't'; return 2;
+    default:
+        memcpy(out + 1, "u00", 3);
+        out[4] = kHex[c >> 4];
+        out[5] = kHex[c & 0xF];
+        return 6;
+    }
+}
+
+char* WriteTwoDigits(char* out, unsigned value) {
+    out[0] = char('0' + value / 10);
+    out[1] = char('0' + value % 10);
+    return out + 2;
+}
+
+}
+
+// A byte needs escaping when it equals '"' or '\\', or when max(byte, 0x1F)
+// is still 0x1F, the unsigned form of byte < 0x20.
+size_t JsonPlainPrefix(std::string_view text) {
+    const char* p = text.data();
+    size_t size = text.size();
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+    for (; i + 32 <= size; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+            _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, control), control));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+        if (mask)
+            return i + std::countr_zero(mask);
+    }
+#elif defined(USN_JSON_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+        if (mask)
+            return i + std::countr_zero(mask);
+    }
+#endif
+
+    while (i < size && !NeedsJsonEscape(static_cast<unsigned char>(p[i])))
+        ++i;
+    return i;
+}
+
+std::string JsonEscape(std::string_view text) {
+    std::string escaped;
+    escaped.reserve(text.size() + 8);
+    while (!text.empty()) {
+        size_t plain = JsonPlainPrefix(text);
+        escaped.append(text.data(), plain);
+        if (plain == text.size())
+            break;
+        char buffer[6];
+        escaped.append(buffer, JsonEscapeChar(static_cast<unsigned char>(text[plain]), buffer));
+        text.remove_prefix(plain + 1);
+    }
+    return escaped;
+}
+
+OutputBuffer::OutputBuffer(std::ostream& out, size_t capacity)
+    : out_(&out), data_(new char[capacity]), capacity_(capacity) {
+}
+
+OutputBuffer::OutputBuffer(size_t capacity)
+    : out_(nullptr), data_(new char[capacity]), capacity_(capacity) {
+}
+
+void OutputBuffer::MakeRoom(size_t count) {
+    if (out_) {
+        Flush();
+        return;
+    }
+    size_t capacity = std::max(capacity_ * 2, used_ + count);
+    std::unique_ptr<char[]> data(new char[capacity]);
+    memcpy(data.get(), data_.get(), used_);
+    data_ = std::move(data);
+    capacity_ = capacity;
+}
+
+void OutputBuffer::AppendLarge(std::string_view text) {
+    if (out_ && text.size() >= capacity_) {
+        Flush();
+        out_->write(text.data(), static_cast<std::streamsize>(text.size()));
+        return;
+    }
+    MakeRoom(text.size());
+    memcpy(data_.get() + used_, text.data(), text.size());
+    used_ += text.size();
+}
+
+void OutputBuffer::AppendNumber(ULONGLONG value) {
+    char* out = Reserve(20);
+    used_ = std::to_chars(out, out + 20, value).ptr - data_.get();
+}
+
+void OutputBuffer::AppendJson(std::string_view text) {
+    while (!text.empty()) {
+        size_t plain = JsonPlainPrefix(text);
+        Append(text.substr(0, plain));
+        if (plain == text.size())
+            return;
+        char* out = Reserve(6);
+        used_ += JsonEscapeChar(static_cast<unsigned char>(text[plain]), out);
+        text.remove_prefix(plain + 1);
+    }
+}
+
+void OutputBuffer::AppendFileId(FileIdKey key, bool wide) {
+    char* out = Reserve(kMaxFileIdText);
+    used_ = WriteFileId(out, key, wide) - data_.get();
+}
+
+void OutputBuffer::AppendDate(const FILETIME& date) {
+    ULONGLONG ticks = (ULONGLONG(date.dwHighDateTime) << 32) | date.dwLowDateTime;
+    ULONGLONG day = ticks / kTicksPerDay;
+    if (day != day_) {
+        std::string text = formatFileTime(date);
+        if (text.size() != 19) {
+            // years past 9999 don't fit the fixed layout
+            Append(text);
+            return;
+        }
+        memcpy(dayText_, text.data(), sizeof(dayText_));
+        day_ = day;
+    }
+
+    ULONGLONG seconds = (ticks % kTicksPerDay) / kTicksPerSecond;
+    char* out = Reserve(19);
+    memcpy(out, dayText_, sizeof(dayText_));
+    char* p = WriteTwoDigits(out + 11, unsigned(seconds / 3600));
+    *p++ = ':';
+    p = WriteTwoDigits(p, unsigned(seconds / 60 % 60));
+    *p++ = ':';
+    p = WriteTwoDigits(p, unsigned(seconds % 60));
+    used_ = p - data_.get();
+}
+
+void OutputBuffer::Flush() {
+    if (out_ && used_ > 0) {
+        out_->write(data_.get(), static_cast<std::streamsize>(used_));
+        used_ = 0;
+    }
+}
+
+void Utf8Cache::Convert(uint32_t id) {
+    if (lengths_.empty())
+        lengths_.resize(offsets_.size());
+    std::string text = to_utf8(pool_.Get(id));
+    offsets_[id] = chars_.size();
+    lengths_[id] = static_cast<uint32_t>(text.size());
+    chars_ += text;
+}
+
+void Utf8Cache::ConvertAll(ThreadPool& threads) {
+    size_t count = offsets_.size();
+    size_t parts = std::min(count, threads.size() * 4);
+    if (parts == 0)
+        return;
+    lengths_.resize(count);
+
+    // each part converts its ids into its own arena, offsets relative to it
+    std::vector<std::string> arenas(parts);
+    threads.ParallelFor(parts, [&](size_t part) {
+        for (size_t id = count * part / parts; id < count * (part + 1) / parts; ++id) {
+            std::string text = to_utf8(pool_.Get(static_cast<uint32_t>(id)));
+            offsets_[id] = arenas[part].size();
+            lengths_[id] = static_cast<uint32_t>(text.size());
+            arenas[part] += text;
+        }
+    });
+
+    chars_.clear();
+    for (size_t part = 0; part < parts; ++part) {
+        size_t base = chars_.size();
+        for (size_t id = count * part / parts; id < count * (part + 1) / parts; ++id)
+            offsets_[id] += base;
+        chars_ += arenas[part];
+    }
+}
\ No newline at end of file
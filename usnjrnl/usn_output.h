@@ -0,0 +1,108 @@
+#pragma once
+
+#include "usn_structs.h"
+#include "usn_file_id.h"
+#include "usn_entry_store.h"
+#include "usn_thread_pool.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Length of the longest prefix of text that goes into a JSON string as is,
+// i.e. without '"', '\\' or control characters. Scans 32 bytes at a time with
+// AVX2, 16 with SSE2, and byte by byte only for the tail.
+size_t JsonPlainPrefix(std::string_view text);
+
+// text escaped for the inside of a JSON string.
+std::string JsonEscape(std::string_view text);
+
+// Staging buffer for the writers: fields are formatted straight into one
+// large reusable block, which goes to the stream with a single write() each
+// time it fills, instead of a chain of small operator<< calls per field.
+// Without a stream the block grows instead and keeps everything appended
+// since Clear(), for rendering ranges on several threads.
+class OutputBuffer {
+public:
+    explicit OutputBuffer(std::ostream& out, size_t capacity = 4 << 20);
+    explicit OutputBuffer(size_t capacity = 1 << 20);
+    ~OutputBuffer() { Flush(); }
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void Append(std::string_view text) {
+        if (text.size() > capacity_ - used_)
+            return AppendLarge(text);
+        memcpy(data_.get() + used_, text.data(), text.size());
+        used_ += text.size();
+    }
+    void Append(char c) {
+        if (used_ == capacity_)
+            MakeRoom(1);
+        data_[used_++] = c;
+    }
+    void AppendNumber(ULONGLONG value);
+
+    // text as the inside of a JSON string.
+    void AppendJson(std::string_view text);
+    void AppendFileId(FileIdKey key, bool wide);
+
+    // Same text as formatFileTime(). The date part is only formatted again
+    // when the day changes, which in journal order is rare.
+    void AppendDate(const FILETIME& date);
+
+    // Writes the buffered bytes to the stream; nothing without one.
+    void Flush();
+
+    std::string_view Contents() const { return std::string_view(data_.get(), used_); }
+    void Clear() { used_ = 0; }
+
+private:
+    char* Reserve(size_t count) {
+        if (count > capacity_ - used_)
+            MakeRoom(count);
+        return data_.get() + used_;
+    }
+    void MakeRoom(size_t count);
+    void AppendLarge(std::string_view text);
+
+    std::ostream* out_;
+    std::unique_ptr<char[]> data_;
+    size_t capacity_;
+    size_t used_ = 0;
+
+    ULONGLONG day_ = ~0ULL;
+    char dayText_[11] = {};  // "YYYY-MM-DD "
+};
+
+// UTF-8 text of the strings of one StringPool, converted the first time each
+// id is asked for. Names and directories repeat a lot, and one cache serves
+// every output format, so each distinct string is converted once.
+class Utf8Cache {
+public:
+    explicit Utf8Cache(const StringPool& pool) : pool_(pool), offsets_(pool.size(), kPending) {}
+
+    // Converts every string up front, split over the pool. Get() only reads
+    // afterwards, so it may then be called from several threads.
+    void ConvertAll(ThreadPool& threads);
+
+    std::string_view Get(uint32_t id) {
+        if (offsets_[id] == kPending)
+            Convert(id);
+        return std::string_view(chars_.data() + offsets_[id], lengths_[id]);
+    }
+
+private:
+    static constexpr size_t kPending = SIZE_MAX;
+
+    void Convert(uint32_t id);
+
+    const StringPool& pool_;
+    std::vector<size_t> offsets_;
+    std::vector<uint32_t> lengths_;
+    std::string chars_;
+};
\ No newline at end of file
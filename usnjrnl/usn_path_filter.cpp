@@ -0,0 +1,98 @@
+#include "usn_path_filter.h"
+#include "usn_name_matcher.h"
+#include "usn_utils.h"
+
+namespace {
+
+bool IsSeparator(WCHAR c) {
+    return c == USN_TEXT('\\') || c == USN_TEXT('/');
+}
+
+// Folds path in place and returns its non-empty components as views into it.
+std::vector<UsnStringView> SplitComponents(UsnString& path) {
+    for (auto& c : path)
+        c = FoldCase(c);
+
+    std::vector<UsnStringView> components;
+    size_t start = 0;
+    for (size_t i = 0; i <= path.size(); ++i) {
+        if (i < path.size() && !IsSeparator(path[i]))
+            continue;
+        if (i > start)
+            components.emplace_back(path.data() + start, i - start);
+        start = i + 1;
+    }
+    return components;
+}
+
+}
+
+void PathFilter::Compile(const std::vector<std::string>& includes, const std::vector<std::string>& excludes, bool recursive) {
+    *this = PathFilter();
+    recursive_ = recursive;
+    nodes_.emplace_back();
+
+    for (const auto& filter : includes)
+        Add(filter, kInclude);
+    for (const auto& filter : excludes)
+        Add(filter, kExclude);
+    hasIncludes_ = !includes.empty();
+    hasExcludes_ = !excludes.empty();
+}
+
+void PathFilter::Add(const std::string& filter, uint8_t flag) {
+    UsnString path = from_utf8(filter);
+    uint32_t node = 0;
+    for (UsnStringView component : SplitComponents(path)) {
+        uint32_t child = 0;
+        for (const auto& [text, index] : nodes_[node].children) {
+            if (text == component) {
+                child = index;
+                break;
+            }
+        }
+        if (child == 0) {
+            child = static_cast<uint32_t>(nodes_.size());
+            nodes_[node].children.emplace_back(UsnString(component), child);
+            nodes_.emplace_back();
+        }
+        node = child;
+    }
+    nodes_[node].flags |= flag;
+}
+
+// Flags of every filter whose components match components[start...].
+uint8_t PathFilter::MatchFrom(const std::vector<UsnStringView>& components, size_t start) const {
+    uint32_t node = 0;
+    uint8_t flags = nodes_[0].flags;
+    for (size_t i = start; i < components.size(); ++i) {
+        uint32_t child = 0;
+        for (const auto& [text, index] : nodes_[node].children) {
+            if (text == components[i]) {
+                child = index;
+                break;
+            }
+        }
+        if (child == 0)
+            break;
+        node = child;
+        flags |= nodes_[node].flags;
+    }
+    return flags;
+}
+
+bool PathFilter::Accepts(UsnStringView directory) const {
+    if (empty())
+        return true;
+
+    UsnString path(directory);
+    std::vector<UsnStringView> components = SplitComponents(path);
+
+    uint8_t flags = MatchFrom(components, 0);
+    for (size_t start = 1; recursive_ && start < components.size() && !(flags & kExclude); ++start)
+        flags |= MatchFrom(components, start);
+
+    if (flags & kExclude)
+        return false;
+    return !hasIncludes_ || (flags & kInclude);
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "usn_structs.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// -p/-P path filters as a trie of case-folded path components. A filter
+// matches a directory when its components line up with the directory's
+// from the root, or from any component when recursive. A directory is kept
+// if it matches an include (or there are none) and matches no exclude.
+class PathFilter {
+public:
+    void Compile(const std::vector<std::string>& includes, const std::vector<std::string>& excludes, bool recursive);
+
+    bool empty() const { return !hasIncludes_ && !hasExcludes_; }
+    bool Accepts(UsnStringView directory) const;
+
+private:
+    static constexpr uint8_t kInclude = 0x01;
+    static constexpr uint8_t kExclude = 0x02;
+
+    struct Node {
+        std::vector<std::pair<UsnString, uint32_t>> children;
+        uint8_t flags = 0;
+    };
+
+    void Add(const std::string& filter, uint8_t flag);
+    uint8_t MatchFrom(const std::vector<UsnStringView>& components, size_t start) const;
+
+    std::vector<Node> nodes_;
+    bool recursive_ = false;
+    bool hasIncludes_ = false;
+    bool hasExcludes_ = false;
+};
\ No newline at end of file
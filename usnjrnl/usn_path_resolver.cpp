@@ -0,0 +1,151 @@
+#include "usn_path_resolver.h"
+#include "usn_utils.h"
+
+namespace {
+
+// Deeper chains only come from corrupt records that link back on themselves.
+constexpr size_t kMaxDepth = 512;
+
+}
+
+JournalPathResolver::JournalPathResolver(UsnStringView volumeRoot, Fallback fallback, Lookup lookup)
+    : volumeRoot_(volumeRoot), fallback_(std::move(fallback)), lookup_(std::move(lookup)) {
+}
+
+// NTFS keeps the root directory in MFT record 5, whatever its sequence number.
+bool JournalPathResolver::IsVolumeRoot(const FileIdVariant& id) {
+    ULONGLONG low = 0, high = 0;
+    if (std::holds_alternative<ULONGLONG>(id)) {
+        low = std::get<ULONGLONG>(id);
+    }
+    else {
+        const auto& id128 = std::get<FILE_ID_128>(id);
+        memcpy(&low, id128.Identifier, sizeof(ULONGLONG));
+        memcpy(&high, id128.Identifier + sizeof(ULONGLONG), sizeof(ULONGLONG));
+    }
+    return high == 0 && (low & 0x0000FFFFFFFFFFFFULL) == 5;
+}
+
+void JournalPathResolver::Seed(const DirectoryChange& change) {
+    if (IsVolumeRoot(change.fileId))
+        return;
+
+    auto [it, inserted] = nodes_.try_emplace(change.fileId);
+    if (!inserted)
+        return;
+    it->second.parent = change.parentId;
+    it->second.nameId = names_.Intern(change.name);
+}
+
+void JournalPathResolver::Apply(const DirectoryChange& change) {
+    auto it = nodes_.find(change.fileId);
+    if (it == nodes_.end() || it->second.checked == kFixedEpoch)
+        return;
+
+    Node& node = it->second;
+    uint32_t nameId = names_.Intern(change.name);
+    if (nameId == node.nameId && FileIdEqual{}(node.parent, change.parentId))
+        return;
+
+    node.parent = change.parentId;
+    node.nameId = nameId;
+    node.moved = true;  // its memo and, through changed, those below it are stale
+    ++epoch_;
+}
+
+void JournalPathResolver::Update(const DirectoryChange& change) {
+    if (IsVolumeRoot(change.fileId))
+        return;
+
+    auto [it, inserted] = nodes_.try_emplace(change.fileId);
+    Node& node = it->second;
+    uint32_t nameId = names_.Intern(change.name);
+    if (!inserted && node.checked != kFixedEpoch && nameId == node.nameId && FileIdEqual{}(node.parent, change.parentId))
+        return;
+
+    node.parent = change.parentId;
+    node.nameId = nameId;
+    node.checked = kNoEpoch;
+    if (!inserted)
+        ++epoch_;  // paths memoized below it are stale
+}
+
+// Walks up to the first ancestor already checked in this epoch (or a fixed
+// one), then back down, rebuilding a memo only where the directory moved or
+// the path above it changed after the memo was last checked.
+uint32_t JournalPathResolver::Resolve(const FileIdVariant& directoryId) {
+    chain_.clear();
+    uint32_t pathId;
+    uint64_t changed = 0;  // when the path above the chain last changed
+
+    for (FileIdVariant current = directoryId;;) {
+        auto it = nodes_.find(current);
+        FileIdVariant parent;
+        UsnStringView name;
+        if (it == nodes_.end() && !IsVolumeRoot(current) && lookup_ && lookup_(current, parent, name)) {
+            // the journal never moved it, so this link holds for the whole walk
+            it = nodes_.try_emplace(current).first;
+            it->second.parent = parent;
+            it->second.nameId = names_.Intern(name);
+        }
+        if (it == nodes_.end()) {
+            if (IsVolumeRoot(current)) {
+                pathId = FixedNode(current, JoinPath(volumeRoot_, USN_TEXT(""))).pathId;
+            }
+            else {
+                ++fallbackCount_;
+                pathId = FixedNode(current, fallback_(current)).pathId;
+            }
+            break;
+        }
+
+        Node& node = it->second;
+        if (node.checked == epoch_ || node.checked == kFixedEpoch) {
+            pathId = node.pathId;
+            changed = node.changed;
+            break;
+        }
+        if (chain_.size() == kMaxDepth) {
+            chain_.clear();
+            pathId = paths_.Intern(USN_TEXT("?"));
+            break;
+        }
+
+        chain_.push_back(&node);
+        current = node.parent;
+    }
+
+    for (auto it = chain_.rbegin(); it != chain_.rend(); ++it) {
+        Node& node = **it;
+        if (node.checked == kNoEpoch || node.moved || changed > node.checked) {
+            uint32_t rebuilt = paths_.Intern(JoinPath(paths_.Get(pathId), names_.Get(node.nameId)));
+            if (node.checked == kNoEpoch || rebuilt != node.pathId) {
+                node.pathId = rebuilt;
+                node.changed = epoch_;
+            }
+            node.moved = false;
+        }
+        node.checked = epoch_;
+        pathId = node.pathId;
+        changed = node.changed;
+    }
+    return pathId;
+}
+
+std::vector<DirectoryChange> JournalPathResolver::Links() const {
+    std::vector<DirectoryChange> links;
+    links.reserve(nodes_.size());
+    for (const auto& [id, node] : nodes_) {
+        if (node.checked != kFixedEpoch)
+            links.push_back({ 0, id, node.parent, UsnString(names_.Get(node.nameId)) });
+    }
+    return links;
+}
+
+JournalPathResolver::Node& JournalPathResolver::FixedNode(const FileIdVariant& id, UsnStringView path) {
+    Node& node = nodes_[id];
+    node.pathId = paths_.Intern(path);
+    node.checked = kFixedEpoch;
+    node.changed = 0;
+    return node;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "usn_structs.h"
+#include "usn_entry_store.h"
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+// Location of a directory as reported by one of its own journal records.
+// position is the index of the first accepted entry at or after the record.
+struct DirectoryChange {
+    size_t position;
+    FileIdVariant fileId;
+    FileIdVariant parentId;
+    UsnString name;
+    size_t replacePosition = 0;  // the same, among the replace detector's events
+};
+
+// Rebuilds directory paths from the journal itself: every directory record
+// gives the (parent, name) of that directory from its USN on, and a path is
+// the walk up those links. Resolved paths are memoized per directory. A move
+// or rename only rebuilds the memos below the directory that moved: the walk
+// up still checks every ancestor, but joins strings only where a directory
+// or one of its ancestors changed since its memo was built. Directories the
+// journal never mentions are asked of the lookup (an $MFT index) for their
+// parent and name, and failing that handed to the fallback once for a path.
+class JournalPathResolver {
+public:
+    using Fallback = std::function<UsnString(const FileIdVariant&)>;
+    using Lookup = std::function<bool(const FileIdVariant&, FileIdVariant& parent, UsnStringView& name)>;
+
+    JournalPathResolver(UsnStringView volumeRoot, Fallback fallback, Lookup lookup = nullptr);
+
+    // First location seen for a directory. Any earlier move would have left
+    // a record of its own, so it also holds for every USN before that one.
+    void Seed(const DirectoryChange& change);
+    // Location of a seeded directory from this change on.
+    void Apply(const DirectoryChange& change);
+    // For records fed as they arrive, with nothing known of later ones: the
+    // location of any directory from this change on, including one so far
+    // only known through the fallback.
+    void Update(const DirectoryChange& change);
+
+    // Path id of a directory as the journal describes it right now.
+    uint32_t Resolve(const FileIdVariant& directoryId);
+    UsnStringView Path(uint32_t pathId) const { return paths_.Get(pathId); }
+
+    size_t FallbackCount() const { return fallbackCount_; }
+
+    // The current location of every directory known from the journal or the
+    // lookup, as changes that Seed the resolver of a later run.
+    std::vector<DirectoryChange> Links() const;
+
+private:
+    static constexpr uint64_t kNoEpoch = 0;
+    static constexpr uint64_t kFixedEpoch = UINT64_MAX;  // fallback and root paths never go stale
+
+    struct Node {
+        FileIdVariant parent;
+        uint32_t nameId = 0;
+        uint32_t pathId = 0;
+        uint64_t checked = kNoEpoch;  // epoch_ when pathId was last known current
+        uint64_t changed = 0;         // epoch_ when pathId last changed
+        bool moved = false;           // parent or name changed since pathId was built
+    };
+
+    static bool IsVolumeRoot(const FileIdVariant& id);
+    Node& FixedNode(const FileIdVariant& id, UsnStringView path);
+
+    UsnString volumeRoot_;
+    Fallback fallback_;
+    Lookup lookup_;
+    std::unordered_map<FileIdVariant, Node, FileIdHash, FileIdEqual> nodes_;
+    StringPool names_;
+    StringPool paths_;
+    std::vector<Node*> chain_;
+    uint64_t epoch_ = 1;  // advances with every move or rename
+    size_t fallbackCount_ = 0;
+};
\ No newline at end of file
@@ -1,39 +1,92 @@
-#pragma once
-
-#include <vector>
-#include <string>
-
-static const std::vector<std::vector<std::string>> COPY_PATTERN_1 = {
-    {"Data Truncation", "Security Change"},
-    {"Data Extend", "Data Truncation", "Security Change"},
-    {"Data Overwrite", "Data Extend", "Data Truncation", "Security Change"},
-    {"Data Overwrite", "Data Extend", "Data Truncation", "Security Change", "Basic Info Change"},
-    {"Data Overwrite", "Data Extend", "Data Truncation", "Security Change", "Basic Info Change", "Close"}
-};
-
-static const std::vector<std::vector<std::string>> COPY_PATTERN_2 = {
-    {"Data Truncation"},
-    {"Data Extend", "Data Truncation"},
-    {"Data Overwrite", "Data Extend", "Data Truncation"},
-    {"Data Overwrite", "Data Extend", "Data Truncation", "Basic Info Change"},
-    {"Data Overwrite", "Data Extend", "Data Truncation", "Basic Info Change", "Close"}
-};
-
-static const std::vector<std::vector<std::string>> EXPLORER_PATTERN = {
-    {"File Delete", "Close"},
-    {"Rename Old Name"},
-    {"Rename New Name"},
-    {"Rename New Name", "Close"}
-};
-
-static const std::vector<std::vector<std::string>> TYPE_PATTERN_1 = {
-    {"Data Extend", "Data Truncation"},
-    {"Data Extend", "Data Truncation", "Close"}
-};
-
-static const std::vector<std::vector<std::string>> TYPE_PATTERN_2 = {
-    {"Data Truncation"},
-    {"Data Extend", "Data Truncation"}
-};
-
+#pragma once
+
+#include "usn_platform.h"
+#include <array>
+#include <cstddef>
+
+struct ReasonFlag { DWORD flag; const char* desc; };
+
+// Display names of the USN_REASON_* flags, as printed and as written in
+// pattern files.
+inline constexpr ReasonFlag kReasonFlags[] = {
+    {USN_REASON_DATA_OVERWRITE, "Data Overwrite"},
+    {USN_REASON_DATA_EXTEND, "Data Extend"},
+    {USN_REASON_DATA_TRUNCATION, "Data Truncation"},
+    {USN_REASON_NAMED_DATA_OVERWRITE, "Named Data Overwrite"},
+    {USN_REASON_NAMED_DATA_EXTEND, "Named Data Extend"},
+    {USN_REASON_NAMED_DATA_TRUNCATION, "Named Data Truncation"},
+    {USN_REASON_FILE_CREATE, "File Create"},
+    {USN_REASON_FILE_DELETE, "File Delete"},
+    {USN_REASON_EA_CHANGE, "EA Change"},
+    {USN_REASON_SECURITY_CHANGE, "Security Change"},
+    {USN_REASON_RENAME_OLD_NAME, "Rename Old Name"},
+    {USN_REASON_RENAME_NEW_NAME, "Rename New Name"},
+    {USN_REASON_INDEXABLE_CHANGE, "Indexable Change"},
+    {USN_REASON_BASIC_INFO_CHANGE, "Basic Info Change"},
+    {USN_REASON_HARD_LINK_CHANGE, "Hard Link Change"},
+    {USN_REASON_COMPRESSION_CHANGE, "Compression Change"},
+    {USN_REASON_ENCRYPTION_CHANGE, "Encryption Change"},
+    {USN_REASON_OBJECT_ID_CHANGE, "Object ID Change"},
+    {USN_REASON_REPARSE_POINT_CHANGE, "Reparse Point Change"},
+    {USN_REASON_STREAM_CHANGE, "Stream Change"},
+    {USN_REASON_TRANSACTED_CHANGE, "Transacted Change"},
+    {USN_REASON_INTEGRITY_CHANGE, "Integrity Change"},
+    {USN_REASON_CLOSE, "Close"}
+};
+
+// Every step of a pattern is the set of USN_REASON_* flags a record must carry
+// (extra flags are fine). Named-stream data changes count as their unnamed
+// counterpart: the old text matcher looked for "Data Extend" as a substring,
+// which "Named Data Extend" satisfies too.
+
+template <size_t N>
+using ReasonPattern = std::array<DWORD, N>;
+
+constexpr DWORD FoldNamedDataReasons(DWORD reason) {
+    return reason | ((reason >> 4) & (USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION));
+}
+
+// reasonAt(i) yields the reason mask of the i-th record of the window.
+template <size_t N, class ReasonAt>
+constexpr bool CheckPatternSequential(const ReasonPattern<N>& pattern, ReasonAt reasonAt) {
+    for (size_t i = 0; i < N; ++i) {
+        if ((FoldNamedDataReasons(reasonAt(i)) & pattern[i]) != pattern[i])
+            return false;
+    }
+    return true;
+}
+
+static constexpr ReasonPattern<5> COPY_PATTERN_1 = {
+    USN_REASON_DATA_TRUNCATION | USN_REASON_SECURITY_CHANGE,
+    USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION | USN_REASON_SECURITY_CHANGE,
+    USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION | USN_REASON_SECURITY_CHANGE,
+    USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION | USN_REASON_SECURITY_CHANGE | USN_REASON_BASIC_INFO_CHANGE,
+    USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION | USN_REASON_SECURITY_CHANGE | USN_REASON_BASIC_INFO_CHANGE | USN_REASON_CLOSE
+};
+
+static constexpr ReasonPattern<5> COPY_PATTERN_2 = {
+    USN_REASON_DATA_TRUNCATION,
+    USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION,
+    USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION,
+    USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION | USN_REASON_BASIC_INFO_CHANGE,
+    USN_REASON_DATA_OVERWRITE | USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION | USN_REASON_BASIC_INFO_CHANGE | USN_REASON_CLOSE
+};
+
+static constexpr ReasonPattern<4> EXPLORER_PATTERN = {
+    USN_REASON_FILE_DELETE | USN_REASON_CLOSE,
+    USN_REASON_RENAME_OLD_NAME,
+    USN_REASON_RENAME_NEW_NAME,
+    USN_REASON_RENAME_NEW_NAME | USN_REASON_CLOSE
+};
+
+static constexpr ReasonPattern<2> TYPE_PATTERN_1 = {
+    USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION,
+    USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION | USN_REASON_CLOSE
+};
+
+static constexpr ReasonPattern<2> TYPE_PATTERN_2 = {
+    USN_REASON_DATA_TRUNCATION,
+    USN_REASON_DATA_EXTEND | USN_REASON_DATA_TRUNCATION
+};
+
 // echo replace uses the same pattern as type so yeah no is needed!
\ No newline at end of file
@@ -0,0 +1,218 @@
+#pragma once
+
+// Win32 types and USN record layouts used by the reader. On Windows this is
+// just the SDK; elsewhere (offline $J analysis on Linux) the on-disk layouts
+// and the few time helpers we need are declared here.
+
+#ifdef _WIN32
+
+#include <Windows.h>
+#include <winioctl.h>
+
+#define USN_TEXT(s) L##s
+
+#else
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#define USN_TEXT(s) u##s
+
+using BYTE = uint8_t;
+using WORD = uint16_t;
+using DWORD = uint32_t;
+using LONG = int32_t;
+using LONGLONG = int64_t;
+using ULONGLONG = uint64_t;
+using DWORDLONG = uint64_t;
+using USN = int64_t;
+using WCHAR = char16_t;
+using BOOL = int;
+using HANDLE = void*;
+
+#define INVALID_HANDLE_VALUE (reinterpret_cast<HANDLE>(-1))
+
+typedef union _LARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _FILETIME {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct _SYSTEMTIME {
+    WORD wYear;
+    WORD wMonth;
+    WORD wDayOfWeek;
+    WORD wDay;
+    WORD wHour;
+    WORD wMinute;
+    WORD wSecond;
+    WORD wMilliseconds;
+} SYSTEMTIME;
+
+typedef struct _FILE_ID_128 {
+    BYTE Identifier[16];
+} FILE_ID_128;
+
+typedef struct {
+    DWORDLONG UsnJournalID;
+    USN FirstUsn;
+    USN NextUsn;
+    USN LowestValidUsn;
+    USN MaxUsn;
+    DWORDLONG MaximumSize;
+    DWORDLONG AllocationDelta;
+} USN_JOURNAL_DATA_V0;
+
+typedef struct {
+    DWORD RecordLength;
+    WORD MajorVersion;
+    WORD MinorVersion;
+} USN_RECORD_COMMON_HEADER;
+
+typedef struct {
+    DWORD RecordLength;
+    WORD MajorVersion;
+    WORD MinorVersion;
+    DWORDLONG FileReferenceNumber;
+    DWORDLONG ParentFileReferenceNumber;
+    USN Usn;
+    LARGE_INTEGER TimeStamp;
+    DWORD Reason;
+    DWORD SourceInfo;
+    DWORD SecurityId;
+    DWORD FileAttributes;
+    WORD FileNameLength;
+    WORD FileNameOffset;
+    WCHAR FileName[1];
+} USN_RECORD_V2;
+
+typedef struct {
+    DWORD RecordLength;
+    WORD MajorVersion;
+    WORD MinorVersion;
+    FILE_ID_128 FileReferenceNumber;
+    FILE_ID_128 ParentFileReferenceNumber;
+    USN Usn;
+    LARGE_INTEGER TimeStamp;
+    DWORD Reason;
+    DWORD SourceInfo;
+    DWORD SecurityId;
+    DWORD FileAttributes;
+    WORD FileNameLength;
+    WORD FileNameOffset;
+    WCHAR FileName[1];
+} USN_RECORD_V3;
+
+typedef struct {
+    LONGLONG Offset;
+    LONGLONG Length;
+} USN_RECORD_EXTENT;
+
+typedef struct {
+    USN_RECORD_COMMON_HEADER Header;
+    FILE_ID_128 FileReferenceNumber;
+    FILE_ID_128 ParentFileReferenceNumber;
+    USN Usn;
+    DWORD Reason;
+    DWORD SourceInfo;
+    DWORD RemainingExtents;
+    WORD NumberOfExtents;
+    WORD ExtentSize;
+    USN_RECORD_EXTENT Extents[1];
+} USN_RECORD_V4;
+
+static_assert(offsetof(USN_RECORD_V2, FileName) == 60, "USN_RECORD_V2 layout");
+static_assert(offsetof(USN_RECORD_V3, FileName) == 76, "USN_RECORD_V3 layout");
+static_assert(offsetof(USN_RECORD_V4, Extents) == 64, "USN_RECORD_V4 layout");
+
+#define USN_REASON_DATA_OVERWRITE           0x00000001
+#define USN_REASON_DATA_EXTEND              0x00000002
+#define USN_REASON_DATA_TRUNCATION          0x00000004
+#define USN_REASON_NAMED_DATA_OVERWRITE     0x00000010
+#define USN_REASON_NAMED_DATA_EXTEND        0x00000020
+#define USN_REASON_NAMED_DATA_TRUNCATION    0x00000040
+#define USN_REASON_FILE_CREATE              0x00000100
+#define USN_REASON_FILE_DELETE              0x00000200
+#define USN_REASON_EA_CHANGE                0x00000400
+#define USN_REASON_SECURITY_CHANGE          0x00000800
+#define USN_REASON_RENAME_OLD_NAME          0x00001000
+#define USN_REASON_RENAME_NEW_NAME          0x00002000
+#define USN_REASON_INDEXABLE_CHANGE         0x00004000
+#define USN_REASON_BASIC_INFO_CHANGE        0x00008000
+#define USN_REASON_HARD_LINK_CHANGE         0x00010000
+#define USN_REASON_COMPRESSION_CHANGE       0x00020000
+#define USN_REASON_ENCRYPTION_CHANGE        0x00040000
+#define USN_REASON_OBJECT_ID_CHANGE         0x00080000
+#define USN_REASON_REPARSE_POINT_CHANGE     0x00100000
+#define USN_REASON_STREAM_CHANGE            0x00200000
+#define USN_REASON_TRANSACTED_CHANGE        0x00400000
+#define USN_REASON_INTEGRITY_CHANGE         0x00800000
+#define USN_REASON_CLOSE                    0x80000000
+
+#define FILE_ATTRIBUTE_DIRECTORY            0x00000010
+
+// FILETIME ticks between 1601-01-01 and the Unix epoch.
+constexpr ULONGLONG FILETIME_UNIX_EPOCH = 116444736000000000ULL;
+
+inline ULONGLONG FileTimeToTicks(const FILETIME* ft) {
+    return (static_cast<ULONGLONG>(ft->dwHighDateTime) << 32) | ft->dwLowDateTime;
+}
+
+inline void TicksToFileTime(ULONGLONG ticks, FILETIME* ft) {
+    ft->dwLowDateTime = static_cast<DWORD>(ticks);
+    ft->dwHighDateTime = static_cast<DWORD>(ticks >> 32);
+}
+
+inline BOOL FileTimeToLocalFileTime(const FILETIME* utc, FILETIME* local) {
+    ULONGLONG ticks = FileTimeToTicks(utc);
+    time_t secs = static_cast<time_t>((ticks - FILETIME_UNIX_EPOCH) / 10000000ULL);
+    tm lt{};
+    if (!localtime_r(&secs, &lt))
+        return 0;
+    TicksToFileTime(ticks + static_cast<LONGLONG>(lt.tm_gmtoff) * 10000000LL, local);
+    return 1;
+}
+
+inline BOOL FileTimeToSystemTime(const FILETIME* ft, SYSTEMTIME* st) {
+    ULONGLONG ticks = FileTimeToTicks(ft);
+    ULONGLONG secs = ticks / 10000000ULL;
+    long long days = static_cast<long long>(secs / 86400);
+    ULONGLONG rem = secs % 86400;
+
+    // days since 1601-01-01 -> civil date (Howard Hinnant's algorithm, shifted to 0000-03-01)
+    long long z = days + 584694;
+    long long era = z / 146097;
+    long long doe = z - era * 146097;
+    long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long long mp = (5 * doy + 2) / 153;
+    long long d = doy - (153 * mp + 2) / 5 + 1;
+    long long m = mp < 10 ? mp + 3 : mp - 9;
+    long long y = yoe + era * 400 + (m <= 2);
+
+    st->wYear = static_cast<WORD>(y);
+    st->wMonth = static_cast<WORD>(m);
+    st->wDay = static_cast<WORD>(d);
+    st->wDayOfWeek = static_cast<WORD>((days + 1) % 7);
+    st->wHour = static_cast<WORD>(rem / 3600);
+    st->wMinute = static_cast<WORD>((rem / 60) % 60);
+    st->wSecond = static_cast<WORD>(rem % 60);
+    st->wMilliseconds = static_cast<WORD>((ticks / 10000) % 1000);
+    return 1;
+}
+
+inline LONG CompareFileTime(const FILETIME* a, const FILETIME* b) {
+    ULONGLONG ta = FileTimeToTicks(a), tb = FileTimeToTicks(b);
+    return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+#endif
\ No newline at end of file
@@ -1,8 +1,10 @@
 ﻿#include "usn_reader.h"
 #include "usn_utils.h"
-#include <Windows.h>
-#include <winioctl.h>
+#include "usn_mapped_file.h"
+#include "usn_scan.h"
+#include "usn_seek.h"
 #include <cstdio>
+#include <cctype>
 #include <chrono>
 #include <string>
 #include <vector>
@@ -11,7 +13,6 @@
 #include <iostream>
 #include <thread>
 #include <mutex>
-#include <shellapi.h>
 #include <fstream>
 #include <ranges>
 #include <algorithm>
@@ -19,26 +20,51 @@
 #include <iomanip>
 #include <sstream>
 #include <set>
+#include <csignal>
+#include <limits>
 
 #include "time_utils.h"
 
+namespace {
+
+// How often --follow looks at a journal file for new records
+constexpr std::chrono::milliseconds kFollowPollInterval(10);
+
+volatile std::sig_atomic_t stopFollowing = 0;
+
+void StopFollowing(int) {
+    stopFollowing = 1;
+}
+
+}
+
 USNJournalReader::USNJournalReader(const std::wstring& volumeLetter) : volumeLetter_(volumeLetter) {}
 
-void USNJournalReader::Run() {
-    std::wcout << L"[*] Starting USN Journal analysis...\n";
+bool USNJournalReader::Run() {
+    std::cout << "[*] Starting USN Journal analysis...\n";
     auto startTime = std::chrono::high_resolution_clock::now();
 
+    pool_ = std::make_unique<ThreadPool>(threads_);
+    if (!Prepare())
+        return false;
     if (!Dump()) {
-        std::wcerr << L"[-] Failed to read the USN Journal.\n";
-        return;
+        std::cerr << "[-] Failed to read the USN Journal.\n";
+        return false;
     }
 
     auto endTime = std::chrono::high_resolution_clock::now();
     double duration = std::chrono::duration<double>(endTime - startTime).count();
 
-    std::wcout << std::format(L"[+] Completed in {:.3f} seconds\n", duration);
-    std::wcout << std::format(L"[+] Total records: {}\n", entries_.size());
-    std::wcout << std::format(L"[+] Total aggregated files: {}\n", EventsFileID().size());
+    std::cout << std::format("[+] Completed in {:.3f} seconds\n", duration);
+    std::cout << std::format("[+] Total records: {}\n", acceptedRecords_);
+    if (filterCounters_.Total() > 0) {
+        std::cout << "[+] Rejected by filter:";
+        for (size_t stage = 0; stage < kStageCount; ++stage)
+            std::cout << (stage ? ", " : " ") << FilterStageName(FilterStage(stage)) << " " << filterCounters_.rejected[stage];
+        std::cout << "\n";
+    }
+    if (keepEntries_)
+        std::cout << std::format("[+] Total aggregated files: {}\n", Aggregation().size());
 
     if (onlyReplace_) {
         if (consoleOutput_)
@@ -56,41 +82,44 @@ void USNJournalReader::Run() {
             WriteReplacesToFile();
         }
     }
+
+    // only once the output is out, so an interrupted run is read again
+    if (!stateFile_.empty())
+        SaveState();
+
+    if (follow_) {
+        Follow();
+        if (!stateFile_.empty())
+            SaveState();
+        Cleanup();
+    }
+    return true;
 }
 
 std::vector<USNEntry> USNJournalReader::GetEntriesCopy() {
     std::lock_guard<std::mutex> lock(entriesMutex_);
-    return entries_;
+    std::vector<USNEntry> copy;
+    copy.reserve(entries_.size());
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        copy.push_back({ entries_.FileId(i), entries_.Usn(i), UsnString(entries_.Name(i)), entries_.Date(i),
+            entries_.Reason(i), UsnString(entries_.Directory(i)) });
+    }
+    return copy;
 }
 
+// Copies the cached aggregation out for callers that want owned strings.
 std::vector<AggregatedUSNEntry> USNJournalReader::EventsFileID() {
-    std::unordered_map<FileIdVariant, AggregatedUSNEntry, FileIdHash, FileIdEqual> aggMap;
-
-    for (auto& entry : GetEntriesCopy()) {
-        auto it = aggMap.find(entry.fileId);
-        if (it == aggMap.end()) {
-            AggregatedUSNEntry agg;
-            agg.fileId = entry.fileId;
-            agg.events.push_back({ entry.date, entry.reason, entry.name, entry.directory });
-            aggMap[entry.fileId] = agg;
-        }
-        else {
-            it->second.events.push_back({ entry.date, entry.reason, entry.name, entry.directory });
-        }
-    }
-
+    const FileAggregation& files = Aggregation();
     std::vector<AggregatedUSNEntry> result;
-    for (auto& [_, agg] : aggMap) {
-        std::sort(agg.events.begin(), agg.events.end(),
-            [](const FileEvent& a, const FileEvent& b) {
-                return CompareFileTime(&a.date, &b.date) < 0;
-            });
-        if (!agg.events.empty()) {
-            const auto& lastEvent = agg.events.back();
-            agg.name = lastEvent.name;
-            agg.directory = lastEvent.directory;
-        }
-        result.push_back(agg);
+    result.reserve(files.size());
+    for (size_t file = 0; file < files.size(); ++file) {
+        AggregatedUSNEntry agg;
+        agg.fileId = entries_.FileId(files.FirstEvent(file));
+        agg.name = UsnString(entries_.Name(files.LastEvent(file)));
+        agg.directory = UsnString(entries_.Directory(files.LastEvent(file)));
+        for (uint32_t i : files.Events(file))
+            agg.events.push_back({ entries_.Date(i), entries_.Reason(i), UsnString(entries_.Name(i)), UsnString(entries_.Directory(i)) });
+        result.push_back(std::move(agg));
     }
 
     return result;
@@ -102,21 +131,65 @@ void USNJournalReader::EnableAfterLogonFilter(time_t logonTime) {
 }
 
 std::string USNJournalReader::FileIdToString(const FileIdVariant& fid) {
-    if (std::holds_alternative<ULONGLONG>(fid)) {
-        return std::to_string(std::get<ULONGLONG>(fid));
-    }
-    else {
-        const auto& fid128 = std::get<FILE_ID_128>(fid);
-        return std::string(reinterpret_cast<const char*>(&fid128), sizeof(FILE_ID_128));
+    return FormatFileId(fid);
+}
+
+// What the options set up before any record is read: the filters, the
+// replace patterns and the $MFT index. Reports its own errors.
+bool USNJournalReader::Prepare() {
+    if (!PrepareFilters())
+        return false;
+
+    std::vector<ReplacePatternDef> patterns = BuiltinReplacePatterns(DetectsReplace(ReplaceType::COPY), DetectsReplace(ReplaceType::TYPE));
+    if (!patternFile_.empty()) {
+        std::string error;
+        if (!LoadReplacePatterns(patternFile_, patterns, error)) {
+            std::cerr << "[-] Failed to load patterns: " << error << "\n";
+            return false;
+        }
     }
+    replaces_.Configure(patterns, DetectsReplace(ReplaceType::EXPLORER));
+    keepEntries_ = !onlyReplace_;
+
+    if (!mftFile_.empty() && !LoadMft())
+        return false;
+    return true;
 }
 
 bool USNJournalReader::Dump() {
+    // a replay has no initial pass, every record comes through Follow()
+    if (!replayFile_.empty())
+        return true;
+
+    if (!journalFile_.empty())
+        return DumpFile();
+
+#ifdef _WIN32
     if (!OpenVolume() || !QueryJournal() || !AllocateBuffer())
         return false;
 
+    bool resumed = LoadState([&](const Checkpoint& saved) -> const char* {
+        if (saved.journalId != journalData_.UsnJournalID)
+            return "The journal was recreated since the last run";
+        if (saved.nextUsn < journalData_.FirstUsn)
+            return "The journal wrapped past the last checkpoint";
+        if (saved.nextUsn > journalData_.NextUsn)
+            return "The last checkpoint lies past the end of the journal";
+        return nullptr;
+    });
+
     READ_USN_JOURNAL_DATA_V0 readData{};
-    readData.StartUsn = journalData_.FirstUsn;
+    readData.StartUsn = timeThreshold_ ? SeekUsnToTime() : journalData_.FirstUsn;
+    if (resumed && checkpoint_.nextUsn >= readData.StartUsn) {
+        readData.StartUsn = checkpoint_.nextUsn;
+        std::cout << std::format("[+] Resuming at USN {}\n", readData.StartUsn);
+    }
+    else if (readData.StartUsn > journalData_.FirstUsn) {
+        USN from = resumed ? checkpoint_.nextUsn : journalData_.FirstUsn;
+        std::cout << std::format("[+] Time window starts at USN {}, reading only the directory records of the {} MB before it\n",
+            readData.StartUsn, (readData.StartUsn - from) >> 20);
+        CollectVolumeDirectories(from, readData.StartUsn);
+    }
     readData.ReasonMask = 0xFFFFFFFF;
     readData.UsnJournalID = journalData_.UsnJournalID;
 
@@ -130,76 +203,695 @@ bool USNJournalReader::Dump() {
         if (bytesReturned <= sizeof(USN))
             break;
 
-        BYTE* ptr = buffer_.get() + sizeof(USN);
-        BYTE* end = buffer_.get() + bytesReturned;
-
-        while (ptr < end) {
-            auto common = reinterpret_cast<USN_RECORD_COMMON_HEADER*>(ptr);
-            if (common->RecordLength == 0) break;
-
-            std::wstring name = L"?";
-            std::wstring directory = L"?";
-            FILETIME ft{}, localTime{};
-            std::string reasonStr;
-            ULONGLONG usn = 0;
-            FileIdVariant fileId{ 0ULL };
-
-            if (common->MajorVersion == 2) {
-                auto rec = reinterpret_cast<USN_RECORD_V2*>(ptr);
-                name.assign(reinterpret_cast<WCHAR*>((BYTE*)rec + rec->FileNameOffset),
-                    rec->FileNameLength / sizeof(WCHAR));
-                directory = GetDirectoryById(rec->ParentFileReferenceNumber);
-                ft.dwLowDateTime = rec->TimeStamp.LowPart;
-                ft.dwHighDateTime = rec->TimeStamp.HighPart;
-                FileTimeToLocalFileTime(&ft, &localTime);
-                reasonStr = ReasonToString(rec->Reason);
-                usn = rec->Usn;
-                fileId = rec->FileReferenceNumber;
-            }
-            else if (common->MajorVersion == 3) {
-                auto rec = reinterpret_cast<USN_RECORD_V3*>(ptr);
-                name.assign(reinterpret_cast<WCHAR*>((BYTE*)rec + rec->FileNameOffset),
-                    rec->FileNameLength / sizeof(WCHAR));
-                directory = GetDirectoryById(rec->ParentFileReferenceNumber);
-                ft.dwLowDateTime = rec->TimeStamp.LowPart;
-                ft.dwHighDateTime = rec->TimeStamp.HighPart;
-                FileTimeToLocalFileTime(&ft, &localTime);
-                reasonStr = ReasonToString(rec->Reason);
-                usn = rec->Usn;
-                fileId = rec->FileReferenceNumber;  // FILE_ID_128
+        ParseRange(buffer_.get() + sizeof(USN), buffer_.get() + bytesReturned, false);
+        readData.StartUsn = *(USN*)buffer_.get();
+    }
+    checkpoint_.journalId = journalData_.UsnJournalID;
+    checkpoint_.nextUsn = readData.StartUsn;
+
+    ResolveDirectories();
+    if (!follow_)
+        Cleanup();
+    return true;
+#else
+    std::cerr << "[-] Live volumes can only be read on Windows, use --journal-file\n";
+    return false;
+#endif
+}
+
+bool USNJournalReader::DumpFile() {
+    MappedFile journal;
+    if (!journal.Open(journalFile_)) {
+        std::cerr << "[-] Failed to open journal file: " << journalFile_ << "\n";
+        return false;
+    }
+
+    // The file has no journal id; it is the same journal as long as the last
+    // record read is still where it was. A wrap or a new journal overwrites
+    // or deallocates it.
+    bool resumed = LoadState([&](const Checkpoint& saved) -> const char* {
+        UsnRecordView rec;
+        if (saved.journalId != 0 || saved.nextOffset > journal.size())
+            return "The journal file is not the one of the last run";
+        if (saved.nextOffset != 0 && (saved.lastOffset >= journal.size()
+            || !ParseUsnRecord(journal.data() + saved.lastOffset, journal.size() - saved.lastOffset, rec)
+            || rec.usn != saved.lastUsn || saved.lastOffset + rec.recordLength != saved.nextOffset))
+            return "The journal file no longer holds the last record read";
+        return nullptr;
+    });
+    size_t resumeAt = resumed ? static_cast<size_t>(checkpoint_.nextOffset) : 0;
+    if (resumeAt)
+        std::cout << std::format("[+] Resuming at offset {}\n", resumeAt);
+
+    entries_.reserve(200000);
+    size_t skipped = 0;
+    for (const auto& [offset, length] : journal.DataRanges()) {
+        if (offset + length <= resumeAt)
+            continue;
+        const BYTE* begin = journal.data() + std::max(offset, resumeAt);
+        const BYTE* end = journal.data() + offset + length;
+        const BYTE* start = timeThreshold_ ? SeekToTime(begin, end) : begin;
+        skipped += start - begin;
+        CollectDirectories(begin, start, true, std::numeric_limits<USN>::max());
+        ParseRange(start, end, true);
+    }
+    if (skipped)
+        std::cout << std::format("[+] Read only the directory records of the {} MB before the time window\n", skipped >> 20);
+
+    if (lastRecord_) {
+        UsnRecordView rec;
+        ParseUsnRecord(lastRecord_, journal.data() + journal.size() - lastRecord_, rec);
+        checkpoint_.journalId = 0;
+        checkpoint_.lastOffset = lastRecord_ - journal.data();
+        checkpoint_.lastUsn = rec.usn;
+        checkpoint_.nextOffset = checkpoint_.lastOffset + rec.recordLength;
+        lastRecord_ = nullptr;
+    }
+
+    ResolveDirectories();
+    return true;
+}
+
+// Splits [begin, end) into chunks that the pool parses concurrently into
+// per-chunk buffers, a wave of a few chunks per thread at a time. Every chunk
+// but the first resyncs on the first plausible record header; when merging, a
+// chunk that doesn't start exactly where the previous one stopped is walked
+// again from there, so the merged entries are the same, and in the same USN
+// order, as a single sequential walk. A wave is merged and freed before the
+// next is parsed, so only a few chunks are ever held at once.
+void USNJournalReader::ParseRange(const BYTE* begin, const BYTE* end, bool rawStream) {
+    const size_t minChunkSize = 4 * 1024 * 1024;
+    size_t size = end - begin;
+    size_t chunkCount = std::max<size_t>(1, size / minChunkSize);
+    size_t chunkSize = ((size / chunkCount) + 7) & ~size_t(7);
+    size_t waveSize = pool_->size() * 2;
+    auto chunkEnd = [&](size_t i) { return i + 1 == chunkCount ? end : begin + (i + 1) * chunkSize; };
+
+    struct Chunk {
+        const BYTE* first = nullptr;
+        const BYTE* stop = nullptr;
+        ParsedRecords parsed;
+    };
+    std::vector<Chunk> chunks(std::min(chunkCount, waveSize));
+
+    const BYTE* expected = begin;
+    for (size_t wave = 0; wave < chunkCount; wave += waveSize) {
+        size_t count = std::min(waveSize, chunkCount - wave);
+        pool_->ParallelFor(count, [&](size_t k) {
+            size_t i = wave + k;
+            const BYTE* chunkBegin = begin + i * chunkSize;
+            Chunk& chunk = chunks[k];
+            chunk.first = i == 0 ? chunkBegin : FindRecordStart(chunkBegin, chunkEnd(i), end);
+            chunk.stop = ParseRecords(chunk.first, chunkEnd(i), end, rawStream, chunk.parsed);
+        });
+
+        for (size_t k = 0; k < count; ++k) {
+            size_t i = wave + k;
+            Chunk& chunk = chunks[k];
+            if (chunk.first != expected) {
+                chunk.parsed.clear();
+                chunk.stop = ParseRecords(expected, chunkEnd(i), end, rawStream, chunk.parsed);
             }
-            else if (common->MajorVersion == 4) {
-                auto rec = reinterpret_cast<USN_RECORD_V4*>(ptr);
-                name = L"[Requires lookup]";
-                directory = GetDirectoryById(rec->FileReferenceNumber);
-                reasonStr = ReasonToString(rec->Reason);
-                usn = rec->Usn;
-                fileId = rec->FileReferenceNumber;  // FILE_ID_128
+
+            if (replaces_.enabled())
+                FeedReplaceDetector(chunk.parsed);
+
+            size_t base = entries_.size();
+            for (auto& change : chunk.parsed.directories) {
+                change.position += base;
+                directoryChanges_.push_back(std::move(change));
             }
+            acceptedRecords_ += chunk.parsed.entries.size();
+            if (chunk.parsed.lastRecord)
+                lastRecord_ = chunk.parsed.lastRecord;
+            if (keepEntries_)
+                entries_.Append(std::move(chunk.parsed.entries));
+            filterCounters_ += chunk.parsed.rejected;
+            chunk.parsed.clear();
+            expected = chunk.stop;
+
+            // a live buffer ends at its first invalid header, and so does the walk
+            if (!rawStream && expected < chunkEnd(i))
+                return;
+        }
+    }
+}
 
-            PushEntry(fileId, usn, name, localTime, reasonStr, directory);
-            ptr += common->RecordLength;
+// Runs the merged records of one chunk through the replace detector, in USN
+// order, and notes where each directory record falls among its events.
+void USNJournalReader::FeedReplaceDetector(ParsedRecords& parsed) {
+    auto change = parsed.directories.begin();
+    for (size_t i = 0; i < parsed.entries.size(); ++i) {
+        for (; change != parsed.directories.end() && change->position <= i; ++change)
+            change->replacePosition = replaces_.Events().size();
+        replaces_.Push(parsed.entries, i);
+    }
+    for (; change != parsed.directories.end(); ++change)
+        change->replacePosition = replaces_.Events().size();
+}
+
+// Walks the records that start in [ptr, stop); a record may run on up to end.
+// Returns where the walk stopped: the first record start at or past stop, or
+// the invalid header that ended a live buffer.
+const BYTE* USNJournalReader::ParseRecords(const BYTE* ptr, const BYTE* stop, const BYTE* end, bool rawStream, ParsedRecords& out) {
+    UsnRecordView rec;
+    while (ptr < stop) {
+        if (!ParseUsnRecord(ptr, end - ptr, rec)) {
+            if (!rawStream) break;
+            // Page padding or a zeroed region of a raw $J stream: records are
+            // 8-byte aligned, so step one slot and skip any zero run after it.
+            ptr += 8;
+            if (ptr < end)
+                ptr += SkipZeroSlots(ptr, end - ptr);
+            continue;
         }
 
+        ProcessRecord(rec, out);
+        out.lastRecord = ptr;
+        ptr += rec.recordLength;
+    }
+    return ptr;
+}
+
+const BYTE* USNJournalReader::FindRecordStart(const BYTE* ptr, const BYTE* stop, const BYTE* end) const {
+    while (ptr < stop) {
+        ptr += SkipZeroSlots(ptr, end - ptr);
+        if (ptr >= stop || IsRecordStart(ptr, end - ptr))
+            return ptr;
+        ptr += 8;
+    }
+    return ptr;
+}
+
+// Walks the records in [ptr, end) that the time seek skips for their
+// directory records alone, so paths in the window start from where those
+// left every directory, as a full read would. Returns false at the first
+// record at or past stopUsn, or at the invalid header that ends a live buffer.
+bool USNJournalReader::CollectDirectories(const BYTE* ptr, const BYTE* end, bool rawStream, USN stopUsn) {
+    UsnRecordView rec;
+    while (ptr < end) {
+        if (!ParseUsnRecord(ptr, end - ptr, rec)) {
+            if (!rawStream)
+                return false;
+            ptr += 8;
+            if (ptr < end)
+                ptr += SkipZeroSlots(ptr, end - ptr);
+            continue;
+        }
+        if ((USN)rec.usn >= stopUsn)
+            return false;
+        if (rec.majorVersion != 4 && (rec.fileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            directoryChanges_.push_back({ entries_.size(), rec.fileId, rec.parentId, UsnString(rec.name), replaces_.Events().size() });
+        lastRecord_ = ptr;
+        ptr += rec.recordLength;
+    }
+    return true;
+}
+
+// The live counterpart of the walk in DumpFile: the directory records of
+// [from, to), read through the journal.
+void USNJournalReader::CollectVolumeDirectories([[maybe_unused]] USN from, [[maybe_unused]] USN to) {
+#ifdef _WIN32
+    const DWORD bufferSize = 32 * 1024 * 1024;
+    READ_USN_JOURNAL_DATA_V0 readData{};
+    readData.StartUsn = from;
+    readData.ReasonMask = 0xFFFFFFFF;
+    readData.UsnJournalID = journalData_.UsnJournalID;
+    DWORD bytesReturned = 0;
+
+    while (readData.StartUsn < to && DeviceIoControl(volumeHandle_, FSCTL_READ_USN_JOURNAL, &readData, sizeof(readData),
+        buffer_.get(), bufferSize, &bytesReturned, nullptr)) {
+        if (bytesReturned <= sizeof(USN))
+            break;
+        if (!CollectDirectories(buffer_.get() + sizeof(USN), buffer_.get() + bytesReturned, false, to))
+            break;
         readData.StartUsn = *(USN*)buffer_.get();
     }
+#endif
+}
+
+// Start of the part of [begin, end) that can hold records at or past the time
+// threshold, found by sampling record timestamps instead of walking to it.
+const BYTE* USNJournalReader::SeekToTime(const BYTE* begin, const BYTE* end) const {
+    auto sample = [&](ULONGLONG offset, ULONGLONG& recordOffset, ULONGLONG& timestamp) {
+        UsnRecordView rec;
+        for (const BYTE* ptr = FindRecordStart(begin + offset, end, end); ptr < end; ptr = FindRecordStart(ptr + 8, end, end)) {
+            // V4 records carry no timestamp, the V2/V3 record of the same change does
+            if (!ParseUsnRecord(ptr, end - ptr, rec) || rec.majorVersion == 4)
+                continue;
+            recordOffset = ptr - begin;
+            timestamp = rec.Ticks();
+            return true;
+        }
+        return false;
+    };
+
+    return begin + SeekByTime(0, end - begin, timeThreshold_, 64 * 1024, sample);
+}
+
+// The live counterpart of SeekToTime: samples the journal through small reads
+// and returns the USN to start the full read from.
+USN USNJournalReader::SeekUsnToTime() {
+#ifdef _WIN32
+    const DWORD probeSize = 64 * 1024;
+    READ_USN_JOURNAL_DATA_V0 probe{};
+    probe.ReasonMask = 0xFFFFFFFF;
+    probe.UsnJournalID = journalData_.UsnJournalID;
+
+    auto sample = [&](ULONGLONG position, ULONGLONG& recordUsn, ULONGLONG& timestamp) {
+        // records never straddle a page, so reads start on one
+        probe.StartUsn = std::max<USN>(journalData_.FirstUsn, (USN)position & ~USN(4095));
+        DWORD bytesReturned = 0;
+        if (!DeviceIoControl(volumeHandle_, FSCTL_READ_USN_JOURNAL, &probe, sizeof(probe),
+            buffer_.get(), probeSize, &bytesReturned, nullptr) || bytesReturned <= sizeof(USN))
+            return false;
+
+        const BYTE* end = buffer_.get() + bytesReturned;
+        UsnRecordView rec;
+        for (const BYTE* ptr = buffer_.get() + sizeof(USN); ptr < end && ParseUsnRecord(ptr, end - ptr, rec); ptr += rec.recordLength) {
+            if (rec.usn < (USN)position || rec.majorVersion == 4)
+                continue;
+            if (rec.usn >= journalData_.NextUsn)
+                return false;
+            recordUsn = rec.usn;
+            timestamp = rec.Ticks();
+            return true;
+        }
+        return false;
+    };
+
+    return (USN)SeekByTime(journalData_.FirstUsn, journalData_.NextUsn, timeThreshold_, 1024 * 1024, sample);
+#else
+    return 0;
+#endif
+}
+
+void USNJournalReader::ProcessRecord(const UsnRecordView& rec, ParsedRecords& out) {
+    // Directory records feed path resolution whether or not they are kept
+    if (rec.majorVersion != 4 && (rec.fileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        out.directories.push_back({ out.entries.size(), rec.fileId, rec.parentId, UsnString(rec.name) });
+
+    UsnStringView name = rec.majorVersion == 4 ? USN_TEXT("[Requires lookup]") : rec.name;
+    FilterStage stage = FilterRecord(rec, name);
+    if (stage != kStageAccepted) {
+        ++out.rejected.rejected[stage];
+        return;
+    }
+
+    // V4 records carry no name, so the file itself is looked up instead.
+    // Everything else gets its directory from the journal once parsing is done.
+    FILETIME localTime{};
+    uint32_t directoryId = UsnEntryStore::kPendingDirectory;
+    if (rec.majorVersion == 4)
+        directoryId = out.entries.DirectoryFor(rec.fileId, [&] { return GetDirectoryById(rec.fileId); });
+    else
+        FileTimeToLocalFileTime(&rec.timeStamp, &localTime);
+
+    out.entries.Append(rec.usn, localTime, rec.reason, rec.fileId, rec.parentId, name, directoryId);
+}
 
-    Cleanup();
+bool USNJournalReader::LoadMft() {
+    mft_ = std::make_unique<MftIndex>();
+    if (!mft_->Open(mftFile_, *pool_)) {
+        std::cerr << "[-] Failed to read MFT file: " << mftFile_ << "\n";
+        mft_.reset();
+        return false;
+    }
+
+    std::cout << std::format("[+] Indexed {} MFT records ({} bytes each)\n", mft_->size(), mft_->RecordSize());
     return true;
 }
 
+// Fills in the directories of the entries and of the replace detector's
+// events from the directory records collected while parsing. The path filter
+// runs here, once the directories are known.
+void USNJournalReader::ResolveDirectories() {
+    ResolveDirectories(entries_, &DirectoryChange::position);
+    if (replaces_.enabled())
+        ResolveDirectories(replaces_.Events(), &DirectoryChange::replacePosition);
+    if (!stateFile_.empty() || follow_) {
+        JournalPathResolver resolver = SeededResolver();
+        for (const auto& change : directoryChanges_)
+            resolver.Apply(change);
+        directoryLinks_ = resolver.Links();
+    }
+    directoryChanges_.clear();
+    directoryChanges_.shrink_to_fit();
+    savedDirectories_.clear();
+    savedDirectories_.shrink_to_fit();
+
+    // Entries share a few thousand directories, so each directory is
+    // checked against the filter once and the verdict reused.
+    if (!pathFilter_.empty()) {
+        std::vector<int8_t> verdict(entries_.Directories().size(), -1);
+        size_t before = entries_.size();
+        entries_.RemoveIf([&](size_t i) {
+            int8_t& match = verdict[entries_.DirectoryId(i)];
+            if (match < 0)
+                match = pathFilter_.Accepts(entries_.Directory(i)) ? 1 : 0;
+            return match == 0;
+        });
+        filterCounters_.rejected[kStagePath] += before - entries_.size();
+        acceptedRecords_ -= before - entries_.size();
+
+        // a replace stays when the file it ended on is in a kept directory
+        const UsnEntryStore& events = replaces_.Events();
+        replaces_.RemoveMatchesIf([&](const ReplaceMatch& match) {
+            return !pathFilter_.Accepts(events.Directory(match.first + match.count - 1));
+        });
+    }
+}
+
+// Walks store in order alongside the directory records, each of which sits
+// at its position member, so every entry gets the path as it stood when its
+// record was written.
+void USNJournalReader::ResolveDirectories(UsnEntryStore& store, size_t DirectoryChange::*position) {
+    JournalPathResolver resolver = SeededResolver();
+
+    std::vector<uint32_t> directoryOfPath;
+    size_t next = 0;
+    for (size_t i = 0; i < store.size(); ++i) {
+        while (next < directoryChanges_.size() && directoryChanges_[next].*position <= i)
+            resolver.Apply(directoryChanges_[next++]);
+
+        if (store.DirectoryId(i) != UsnEntryStore::kPendingDirectory)
+            continue;
+
+        uint32_t pathId = resolver.Resolve(store.ParentId(i));
+        if (pathId >= directoryOfPath.size())
+            directoryOfPath.resize(pathId + 1, UsnEntryStore::kPendingDirectory);
+        if (directoryOfPath[pathId] == UsnEntryStore::kPendingDirectory)
+            directoryOfPath[pathId] = store.InternDirectory(resolver.Path(pathId));
+        store.SetDirectory(i, directoryOfPath[pathId]);
+    }
+}
+
+// The links saved by the last run are where every directory stood when this
+// run's records begin, so they seed first; a directory's first record here
+// (perhaps the new name of a rename) only seeds the directories they lack.
+JournalPathResolver USNJournalReader::SeededResolver() {
+    UsnString volumeRoot(volumeLetter_.begin(), volumeLetter_.end());
+    JournalPathResolver::Lookup lookup;
+    if (mft_) {
+        lookup = [this](const FileIdVariant& id, FileIdVariant& parent, UsnStringView& name) {
+            return mft_->Lookup(id, parent, name);
+        };
+    }
+    JournalPathResolver resolver(volumeRoot, [this](const FileIdVariant& id) { return GetDirectoryById(id); }, lookup);
+
+    for (const auto& change : savedDirectories_)
+        resolver.Seed(change);
+    for (const auto& change : directoryChanges_)
+        resolver.Seed(change);
+    return resolver;
+}
+
+// Everything is taken from the state file or nothing is: a checkpoint that
+// check() rejects, a damaged file or other replace patterns all mean a full
+// read, as if there were no state.
+bool USNJournalReader::LoadState(const std::function<const char*(const Checkpoint&)>& check) {
+    checkpoint_ = Checkpoint();
+    if (stateFile_.empty())
+        return false;
+
+    std::string bytes;
+    if (!ReadStateFile(stateFile_, bytes)) {
+        std::cout << "[*] No state in " << stateFile_ << " yet, reading the whole journal\n";
+        return false;
+    }
+
+    StateReader in(bytes);
+    char magic[sizeof(kStateMagic)] = {};
+    uint32_t version = 0;
+    Checkpoint saved;
+    if (!in.Get(magic) || memcmp(magic, kStateMagic, sizeof(magic)) != 0 || !in.Get(version) || version != kStateVersion
+        || !in.Get(saved.journalId) || !in.Get(saved.nextUsn) || !in.Get(saved.nextOffset)
+        || !in.Get(saved.lastOffset) || !in.Get(saved.lastUsn)) {
+        std::cout << "[*] " << stateFile_ << " is not a state file of this version, reading the whole journal\n";
+        return false;
+    }
+    if (const char* reason = check(saved)) {
+        std::cout << "[*] " << reason << ", reading the whole journal\n";
+        return false;
+    }
+
+    uint64_t count = 0;
+    std::vector<DirectoryChange> directories;
+    bool ok = in.GetCount(count, 2 * (1 + sizeof(FileIdKey)) + sizeof(uint64_t));
+    for (size_t i = 0; ok && i < count; ++i) {
+        DirectoryChange& change = directories.emplace_back();
+        change.position = 0;
+        ok = in.GetFileId(change.fileId) && in.GetFileId(change.parentId) && in.GetString(change.name);
+    }
+    if (!ok) {
+        std::cout << "[*] " << stateFile_ << " is damaged, reading the whole journal\n";
+        return false;
+    }
+    if (!replaces_.Load(in)) {
+        if (in.ok())
+            std::cout << "[*] The replace patterns changed since the last run, reading the whole journal\n";
+        else
+            std::cout << "[*] " << stateFile_ << " is damaged, reading the whole journal\n";
+        return false;
+    }
+
+    checkpoint_ = saved;
+    savedDirectories_ = std::move(directories);
+    return true;
+}
+
+void USNJournalReader::SaveState() {
+    StateWriter out;
+    out.Put(kStateMagic);
+    out.Put(kStateVersion);
+    out.Put(checkpoint_.journalId);
+    out.Put(checkpoint_.nextUsn);
+    out.Put(checkpoint_.nextOffset);
+    out.Put(checkpoint_.lastOffset);
+    out.Put(checkpoint_.lastUsn);
+
+    out.Put<uint64_t>(directoryLinks_.size());
+    for (const auto& link : directoryLinks_) {
+        out.PutFileId(link.fileId);
+        out.PutFileId(link.parentId);
+        out.PutString(link.name);
+    }
+    replaces_.Save(out);
+
+    std::string error;
+    if (!WriteStateFile(stateFile_, out.Bytes(), error))
+        std::cerr << "[-] Failed to save state to " << stateFile_ << ": " << error << "\n";
+    else
+        std::cout << "[+] State saved to " << stateFile_ << "\n";
+}
+
+// Once the initial pass is written, keeps reading what the journal adds and
+// writes every batch as soon as it is parsed, to the same files (appended)
+// or the console, until Ctrl+C or the end of a replay.
+void USNJournalReader::Follow() {
+    std::unique_ptr<JournalSource> source = OpenFollowSource();
+    if (!source)
+        return;
+
+    std::vector<std::unique_ptr<std::ofstream>> files;
+    auto open = [&](const std::string& filename) -> std::ostream* {
+        if (consoleOutput_)
+            return &std::cout;
+        auto out = std::make_unique<std::ofstream>(filename, std::ios::app);
+        if (!*out) {
+            std::cerr << "[-] Failed to open output file: " << filename << "\n";
+            return nullptr;
+        }
+        files.push_back(std::move(out));
+        return files.back().get();
+    };
+
+    std::vector<std::pair<OutputFormat, std::ostream*>> entryTargets;
+    std::vector<std::tuple<OutputFormat, uint32_t, std::ostream*>> replaceTargets;
+    for (size_t i = 0; i < outputFormats_.size(); ++i) {
+        OutputFormat fmt = outputFormats_[i];
+        if (keepEntries_ && !OutputShadowed(i)) {
+            if (std::ostream* out = open(OutputFileName(i)))
+                entryTargets.emplace_back(fmt, out);
+        }
+        if (std::find(outputFormats_.begin() + i + 1, outputFormats_.end(), fmt) != outputFormats_.end())
+            continue;
+        for (uint32_t kind = 0; kind < replaces_.Kinds().size(); ++kind) {
+            if (std::ostream* out = open(replaces_.Kinds()[kind] + "_replaces." + GetExtension(fmt)))
+                replaceTargets.emplace_back(fmt, kind, out);
+        }
+    }
+
+    // the initial pass is written already; only its directories carry over
+    entries_.clear();
+    replaces_.ClearMatches();
+    savedDirectories_ = std::move(directoryLinks_);
+    JournalPathResolver resolver = SeededResolver();
+    savedDirectories_.clear();
+
+    following_ = true;
+    stopFollowing = 0;
+    auto previousHandler = std::signal(SIGINT, StopFollowing);
+    std::cout << "[*] Following the journal, Ctrl+C to stop\n" << std::flush;
+
+    size_t records = 0;
+    std::vector<double> latencies;  // ms from a batch's arrival until it was written
+    auto started = std::chrono::steady_clock::now();
+    JournalBatch batch;
+    bool alive = true;
+    while (!stopFollowing && (alive = source->Next(batch, std::chrono::milliseconds(250)))) {
+        if (batch.size == 0)
+            continue;
+
+        ParsedRecords parsed;
+        const BYTE* end = batch.data + batch.size;
+        ParseRecords(batch.data, end, end, batch.rawStream, parsed);
+        records += parsed.entries.size() + parsed.rejected.Total();
+
+        if (!journalFile_.empty() && parsed.lastRecord) {
+            UsnRecordView rec;
+            ParseUsnRecord(parsed.lastRecord, end - parsed.lastRecord, rec);
+            checkpoint_.lastOffset = batch.offset + (parsed.lastRecord - batch.data);
+            checkpoint_.lastUsn = rec.usn;
+            checkpoint_.nextOffset = checkpoint_.lastOffset + rec.recordLength;
+        }
+        else if (journalFile_.empty()) {
+            checkpoint_.nextUsn = batch.nextUsn;
+        }
+
+        FollowBatch(parsed, resolver, entryTargets, replaceTargets);
+        latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batch.arrived).count());
+    }
+
+    std::signal(SIGINT, previousHandler);
+    following_ = false;
+    directoryLinks_ = resolver.Links();
+    if (!alive && replayFile_.empty())
+        std::cerr << "[-] Stopped following: the journal can no longer be read\n";
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << std::format("[+] Followed {} records in {:.3f} seconds ({:.0f} records/s)\n",
+        records, seconds, seconds > 0 ? records / seconds : 0.0);
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) { return latencies[static_cast<size_t>(p * (latencies.size() - 1))]; };
+        std::cout << std::format("[+] Latency over {} batches: median {:.2f} ms, 99th percentile {:.2f} ms, max {:.2f} ms\n",
+            latencies.size(), percentile(0.5), percentile(0.99), latencies.back());
+    }
+}
+
+std::unique_ptr<JournalSource> USNJournalReader::OpenFollowSource() {
+    if (!replayFile_.empty()) {
+        auto replay = std::make_unique<ReplayJournalSource>(replayFile_, replayRate_);
+        if (!replay->Open()) {
+            std::cerr << "[-] Failed to open replay file: " << replayFile_ << "\n";
+            return nullptr;
+        }
+        std::cout << std::format("[+] Replaying {} records at {}\n", replay->size(),
+            replayRate_ > 0 ? std::format("{} records/s", replayRate_) : std::string("full speed"));
+        return replay;
+    }
+    if (!journalFile_.empty())
+        return std::make_unique<FileJournalSource>(journalFile_, checkpoint_.nextOffset, kFollowPollInterval);
+#ifdef _WIN32
+    return std::make_unique<VolumeJournalSource>(volumeHandle_, journalData_, checkpoint_.nextUsn);
+#else
+    return nullptr;
+#endif
+}
+
+// One batch of --follow, the streaming counterpart of ResolveDirectories and
+// the writers: directories are resolved as the journal stands at each
+// record, with nothing known of later ones.
+void USNJournalReader::FollowBatch(ParsedRecords& parsed, JournalPathResolver& resolver,
+    const std::vector<std::pair<OutputFormat, std::ostream*>>& entryTargets,
+    const std::vector<std::tuple<OutputFormat, uint32_t, std::ostream*>>& replaceTargets) {
+    UsnEntryStore& store = parsed.entries;
+    auto resolve = [&](UsnEntryStore& target, size_t i) {
+        if (target.DirectoryId(i) == UsnEntryStore::kPendingDirectory)
+            target.SetDirectory(i, target.InternDirectory(resolver.Path(resolver.Resolve(target.ParentId(i)))));
+    };
+
+    auto change = parsed.directories.begin();
+    for (size_t i = 0; i < store.size(); ++i) {
+        for (; change != parsed.directories.end() && change->position <= i; ++change)
+            resolver.Update(*change);
+        resolve(store, i);
+    }
+    for (; change != parsed.directories.end(); ++change)
+        resolver.Update(*change);
+
+    if (replaces_.enabled()) {
+        FeedReplaceDetector(parsed);
+        // events carried over from before this batch may still lack theirs
+        UsnEntryStore& events = replaces_.Events();
+        for (size_t i = 0; i < events.size(); ++i)
+            resolve(events, i);
+    }
+
+    if (!pathFilter_.empty()) {
+        size_t before = store.size();
+        store.RemoveIf([&](size_t i) { return !pathFilter_.Accepts(store.Directory(i)); });
+        filterCounters_.rejected[kStagePath] += before - store.size();
+        const UsnEntryStore& events = replaces_.Events();
+        replaces_.RemoveMatchesIf([&](const ReplaceMatch& match) {
+            return !pathFilter_.Accepts(events.Directory(match.first + match.count - 1));
+        });
+    }
+    acceptedRecords_ += store.size();
+    filterCounters_ += parsed.rejected;
+
+    if (keepEntries_ && !store.empty()) {
+        entries_ = std::move(store);
+        Utf8Cache names(entries_.Names());
+        Utf8Cache directories(entries_.Directories());
+        for (const auto& [fmt, stream] : entryTargets) {
+            OutputBuffer out(*stream);
+            RenderEntries(out, fmt, 0, entries_.size(), names, directories);
+        }
+        entries_.clear();
+    }
+
+    for (const auto& match : replaces_.Matches()) {
+        std::string title = replaces_.Kinds()[match.kind];
+        title[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(title[0])));
+        for (const auto& [fmt, kind, stream] : replaceTargets) {
+            if (kind != match.kind)
+                continue;
+            if (replaces_.IsExplorer(kind))
+                WriteExplorerReplaceEntry(*stream, fmt, match, true);
+            else
+                WriteReplaceEntry(*stream, fmt, match, title, true);
+        }
+    }
+    replaces_.ClearMatches();
+
+    for (const auto& [fmt, stream] : entryTargets)
+        stream->flush();
+    for (const auto& [fmt, kind, stream] : replaceTargets)
+        stream->flush();
+}
+
 bool USNJournalReader::OpenVolume() {
+#ifdef _WIN32
     std::wstring devicePath = L"\\\\.\\" + volumeLetter_;
     volumeHandle_ = CreateFileW(devicePath.c_str(), GENERIC_READ,
         FILE_SHARE_READ | FILE_SHARE_WRITE,
         nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
     return volumeHandle_ != INVALID_HANDLE_VALUE;
+#else
+    return false;
+#endif
 }
 
 bool USNJournalReader::QueryJournal() {
+#ifdef _WIN32
     DWORD bytesReturned = 0;
     return DeviceIoControl(volumeHandle_, FSCTL_QUERY_USN_JOURNAL, nullptr, 0,
         &journalData_, sizeof(journalData_), &bytesReturned, nullptr);
+#else
+    return false;
+#endif
 }
 
 bool USNJournalReader::AllocateBuffer() {
@@ -208,7 +900,15 @@ bool USNJournalReader::AllocateBuffer() {
     return buffer_ != nullptr;
 }
 
-std::wstring USNJournalReader::GetDirectoryById(ULONGLONG fileId) {
+UsnString USNJournalReader::GetDirectoryById(const FileIdVariant& fileId) {
+    return std::visit([this](const auto& id) { return GetDirectoryById(id); }, fileId);
+}
+
+UsnString USNJournalReader::GetDirectoryById([[maybe_unused]] ULONGLONG fileId) {
+#ifdef _WIN32
+    if (volumeHandle_ == INVALID_HANDLE_VALUE)
+        return USN_TEXT("?");
+
     FileIdVariant key = fileId;
     {
         std::lock_guard<std::mutex> lock(cacheMutex_);
@@ -245,9 +945,16 @@ std::wstring USNJournalReader::GetDirectoryById(ULONGLONG fileId) {
     }
 
     return directory;
+#else
+    return USN_TEXT("?");
+#endif
 }
 
-std::wstring USNJournalReader::GetDirectoryById(const FILE_ID_128& fileId128) {
+UsnString USNJournalReader::GetDirectoryById([[maybe_unused]] const FILE_ID_128& fileId128) {
+#ifdef _WIN32
+    if (volumeHandle_ == INVALID_HANDLE_VALUE)
+        return USN_TEXT("?");
+
     FileIdVariant key = fileId128;
     {
         std::lock_guard<std::mutex> lock(cacheMutex_);
@@ -288,38 +995,14 @@ std::wstring USNJournalReader::GetDirectoryById(const FILE_ID_128& fileId128) {
     }
 
     return directory;
+#else
+    return USN_TEXT("?");
+#endif
 }
 
 std::string USNJournalReader::ReasonToString(DWORD reason) const {
-    struct ReasonFlag { DWORD flag; const char* desc; };
-    static const ReasonFlag reasons[] = {
-        {USN_REASON_DATA_OVERWRITE, "Data Overwrite"},
-        {USN_REASON_DATA_EXTEND, "Data Extend"},
-        {USN_REASON_DATA_TRUNCATION, "Data Truncation"},
-        {USN_REASON_NAMED_DATA_OVERWRITE, "Named Data Overwrite"},
-        {USN_REASON_NAMED_DATA_EXTEND, "Named Data Extend"},
-        {USN_REASON_NAMED_DATA_TRUNCATION, "Named Data Truncation"},
-        {USN_REASON_FILE_CREATE, "File Create"},
-        {USN_REASON_FILE_DELETE, "File Delete"},
-        {USN_REASON_EA_CHANGE, "EA Change"},
-        {USN_REASON_SECURITY_CHANGE, "Security Change"},
-        {USN_REASON_RENAME_OLD_NAME, "Rename Old Name"},
-        {USN_REASON_RENAME_NEW_NAME, "Rename New Name"},
-        {USN_REASON_INDEXABLE_CHANGE, "Indexable Change"},
-        {USN_REASON_BASIC_INFO_CHANGE, "Basic Info Change"},
-        {USN_REASON_HARD_LINK_CHANGE, "Hard Link Change"},
-        {USN_REASON_COMPRESSION_CHANGE, "Compression Change"},
-        {USN_REASON_ENCRYPTION_CHANGE, "Encryption Change"},
-        {USN_REASON_OBJECT_ID_CHANGE, "Object ID Change"},
-        {USN_REASON_REPARSE_POINT_CHANGE, "Reparse Point Change"},
-        {USN_REASON_STREAM_CHANGE, "Stream Change"},
-        {USN_REASON_TRANSACTED_CHANGE, "Transacted Change"},
-        {USN_REASON_INTEGRITY_CHANGE, "Integrity Change"},
-        {USN_REASON_CLOSE, "Close"}
-    };
-
     std::string result;
-    for (const auto& r : reasons)
+    for (const auto& r : kReasonFlags)
         if (reason & r.flag) {
             if (!result.empty()) result += " | ";
             result += r.desc;
@@ -328,424 +1011,373 @@ std::string USNJournalReader::ReasonToString(DWORD reason) const {
     return result.empty() ? "?" : result;
 }
 
-bool USNJournalReader::CheckPatternSequential(
-    const std::vector<std::string>& window,
-    const std::vector<std::vector<std::string>>& pattern
-) {
-    if (window.size() != pattern.size())
-        return false;
+// Text form of a reason mask, built once per distinct mask by the writers.
+const std::string& USNJournalReader::ReasonText(DWORD reason) {
+    auto it = reasonText_.find(reason);
+    if (it == reasonText_.end())
+        it = reasonText_.emplace(reason, ReasonToString(reason)).first;
+    return it->second;
+}
 
-    for (size_t i = 0; i < pattern.size(); ++i) {
-        for (const auto& requiredFlag : pattern[i]) {
-            if (window[i].find(requiredFlag) == std::string::npos)
-                return false;
+// -L and -A both keep records from a point in time on, so they fold into one
+// raw UTC threshold. -n tokens become one automaton and -i values a hash set
+// of exact ids. -r tokens keep their substring semantics: a token selects
+// every flag whose name contains it ("Overwrite" selects both data overwrite
+// flags), and "?" selects records without any reason.
+bool USNJournalReader::PrepareFilters() {
+    timeThreshold_ = 0;
+    if (filterAfterLogon_)
+        timeThreshold_ = std::max(timeThreshold_, TimeTToUtcTicks(logonTime_));
+    if (filterAfterDate_)
+        timeThreshold_ = std::max(timeThreshold_, TimeTToUtcTicks(filterDate_));
+
+    nameMatcher_.Compile(filterNames_, filterNamesIgnoreCase_);
+    pathFilter_.Compile(filterPaths_, filterPathExcludes_, filterPathRecursive_);
+
+    idFilter_.clear();
+    for (const auto& filter : filterIds_) {
+        FileIdKey key;
+        if (!ParseFileId(filter, key)) {
+            std::cerr << "[-] Invalid file ID: " << filter << "\n";
+            return false;
         }
+        idFilter_.Insert(filterIdsBySegment_ ? SegmentOf(key) : key);
     }
 
+    filterReasonMask_ = 0;
+    filterReasonUnknown_ = false;
+    for (const auto& filter : filterReasons_) {
+        for (const auto& r : kReasonFlags)
+            if (std::string_view(r.desc).find(filter) != std::string_view::npos)
+                filterReasonMask_ |= r.flag;
+        if (std::string_view("?").find(filter) != std::string_view::npos)
+            filterReasonUnknown_ = true;
+    }
     return true;
 }
 
-bool USNJournalReader::IsCopyReplacement(const std::vector<FileEvent>& events) {
-    if (events.size() < 5)
-        return false;
-
-    for (size_t i = 0; i + 5 <= events.size(); ++i) {
-        std::vector<std::string> window;
-        for (size_t j = 0; j < 5; ++j)
-            window.push_back(events[i + j].reason);
-
-        if (CheckPatternSequential(window, COPY_PATTERN_1) ||
-            CheckPatternSequential(window, COPY_PATTERN_2))
-            return true;
+// Built on first use, for the summary and EventsFileID().
+const FileAggregation& USNJournalReader::Aggregation() {
+    if (!aggregated_) {
+        aggregation_.Build(entries_);
+        aggregated_ = true;
     }
-
-    return false;
+    return aggregation_;
 }
 
-bool USNJournalReader::IsTypeReplacement(const std::vector<FileEvent>& events) {
-    if (events.size() < 2)
-        return false;
-
-    for (size_t i = 0; i + 2 <= events.size(); ++i) {
-        std::vector<std::string> window;
-        for (size_t j = 0; j < 2; ++j)
-            window.push_back(events[i + j].reason);
-
-        if (CheckPatternSequential(window, TYPE_PATTERN_1) ||
-            CheckPatternSequential(window, TYPE_PATTERN_2))
-            return true;
-    }
-
-    return false;
+bool USNJournalReader::DetectsReplace(ReplaceType type) const {
+    return std::find(detectReplaces_.begin(), detectReplaces_.end(), type) != detectReplaces_.end() ||
+        std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end();
 }
 
-bool USNJournalReader::IsExplorerReplacement(const std::vector<USNEntry>& orderedEntries, size_t startIndex) {
-    if (startIndex + 4 > orderedEntries.size())
-        return false;
-
-    std::wstring commonName = orderedEntries[startIndex].name;
-    for (size_t i = 1; i < 4; ++i) {
-        if (orderedEntries[startIndex + i].name != commonName)
-            return false;
-    }
-
-    std::vector<std::string> window;
-    for (size_t j = 0; j < 4; ++j)
-        window.push_back(orderedEntries[startIndex + j].reason);
-
-    return CheckPatternSequential(window, EXPLORER_PATTERN);
-}
-
-void USNJournalReader::PushEntry(
-    FileIdVariant fileId,
-    ULONGLONG usn,
-    const std::wstring& name,
-    const FILETIME& date,
-    const std::string& reason,
-    const std::wstring& dir)
-{
-    if (filterAfterLogon_) {
-        time_t eventTime = LocalFileTimeToTimeT(date);
-        if (eventTime < logonTime_)
-            return;
-    }
-
-    if (filterAfterDate_) {
-        time_t eventTime = LocalFileTimeToTimeT(date);
-        if (eventTime < filterDate_)
-            return;
-    }
-
-    if (!filterNames_.empty()) {
-        std::string nameUtf8 = to_utf8(name);
-        bool match = false;
-        for (const auto& filter : filterNames_) {
-            if (nameUtf8.find(filter) != std::string::npos) {
-                match = true;
-                break;
-            }
-        }
-        if (!match) return;
-    }
+// Header stages first, then the name. The path stage runs in
+// ResolveDirectories, once directories are known.
+FilterStage USNJournalReader::FilterRecord(const UsnRecordView& rec, UsnStringView name) {
+    if (timeThreshold_ && rec.Ticks() < timeThreshold_)
+        return kStageTime;
 
     if (!filterReasons_.empty()) {
-        bool match = false;
-        for (const auto& filter : filterReasons_) {
-            if (reason.find(filter) != std::string::npos) {
-                match = true;
-                break;
-            }
-        }
-        if (!match) return;
+        bool match = rec.reason ? (rec.reason & filterReasonMask_) != 0 : filterReasonUnknown_;
+        if (!match) return kStageReason;
     }
 
     if (!filterIds_.empty()) {
-        std::string idStr = FileIdToString(fileId);
-        bool match = false;
-        for (const auto& filter : filterIds_) {
-            if (idStr.find(filter) != std::string::npos) {
-                match = true;
-                break;
-            }
-        }
-        if (!match) return;
-    }
-
-    if (!filterPaths_.empty()) {
-        std::string dirUtf8 = to_utf8(dir);
-        bool match = false;
-        for (const auto& filter : filterPaths_) {
-            if (filterPathRecursive_) {
-                if (dirUtf8.find(filter) != std::string::npos) {
-                    match = true;
-                    break;
-                }
-            }
-            else {
-                if (dirUtf8 == filter || dirUtf8.find(filter + "\\") == 0) {
-                    match = true;
-                    break;
-                }
-            }
-        }
-        if (!match) return;
+        FileIdKey key = MakeFileIdKey(rec.fileId);
+        if (!idFilter_.Contains(filterIdsBySegment_ ? SegmentOf(key) : key))
+            return kStageFileId;
     }
 
-    USNEntry entry{ fileId, usn, name, date, reason, dir };
-    std::lock_guard<std::mutex> lock(entriesMutex_);
-    entries_.push_back(entry);
+    if (!filterNames_.empty() && !nameMatcher_.Matches(name))
+        return kStageName;
+
+    return kStageAccepted;
 }
 
 void USNJournalReader::Cleanup() {
+#ifdef _WIN32
     if (volumeHandle_ != INVALID_HANDLE_VALUE) {
         CloseHandle(volumeHandle_);
         volumeHandle_ = INVALID_HANDLE_VALUE;
     }
+#endif
     buffer_.reset();  // RAII cleanup
 }
 
 void USNJournalReader::WriteIndividualToFile() {
+    Utf8Cache names(entries_.Names());
+    Utf8Cache directories(entries_.Directories());
+    names.ConvertAll(*pool_);
+    directories.ConvertAll(*pool_);
+    WarmReasonText(entries_);
+
+    std::vector<std::unique_ptr<std::ostream>> files;
+    std::vector<std::string> fileNames;
+    std::vector<std::pair<OutputFormat, std::ostream*>> targets;
+    std::vector<std::string> arrowFiles;
     for (size_t i = 0; i < outputFormats_.size(); ++i) {
+        if (OutputShadowed(i))
+            continue;
         OutputFormat fmt = outputFormats_[i];
-        std::string filename = (i < outputFiles_.size()) ? outputFiles_[i] : outputFiles_.back();
-        if (fmt == OutputFormat::TXT && filename.find('.') == std::string::npos) filename += ".txt";
-        else if (fmt == OutputFormat::CSV && filename.find('.') == std::string::npos) filename += ".csv";
-        else if (fmt == OutputFormat::JSON && filename.find('.') == std::string::npos) filename += ".json";
-
-        std::ofstream out(filename);
-        if (!out) {
-            std::wcerr << L"[-] Failed to open output file: " << std::wstring(filename.begin(), filename.end()) << L"\n";
+        std::string filename = OutputFileName(i);
+        if (fmt == OutputFormat::ARROW) {
+            arrowFiles.push_back(filename);
             continue;
         }
-
-        if (fmt == OutputFormat::TXT) {
-            for (const auto& entry : entries_) {
-                out << "Name: " << to_utf8(entry.name) << "\n";
-                out << "Directory: " << to_utf8(entry.directory) << "\n";
-                out << "File ID: " << FileIdToString(entry.fileId) << "\n";
-                out << "USN: " << entry.usn << "\n";
-                out << "Date: " << formatFileTime(entry.date) << "\n";
-                out << "Reason: " << entry.reason << "\n";
-                out << "---\n";
-            }
-        }
-        else if (fmt == OutputFormat::CSV) {
-            out << "Name,Directory,File ID,USN,Date,Reason\n";
-            for (const auto& entry : entries_) {
-                out << "\"" << to_utf8(entry.name) << "\",";
-                out << "\"" << to_utf8(entry.directory) << "\",";
-                out << "\"" << FileIdToString(entry.fileId) << "\",";
-                out << entry.usn << ",";
-                out << "\"" << formatFileTime(entry.date) << "\",";
-                out << "\"" << entry.reason << "\"\n";
-            }
-        }
-        else if (fmt == OutputFormat::JSON) {
-            out << "[\n";
-            for (size_t j = 0; j < entries_.size(); ++j) {
-                const auto& entry = entries_[j];
-                out << "  {\n";
-                out << "    \"name\": \"" << to_utf8(entry.name) << "\",\n";
-                out << "    \"directory\": \"" << to_utf8(entry.directory) << "\",\n";
-                out << "    \"fileId\": \"" << FileIdToString(entry.fileId) << "\",\n";
-                out << "    \"usn\": " << entry.usn << ",\n";
-                out << "    \"date\": \"" << formatFileTime(entry.date) << "\",\n";
-                out << "    \"reason\": \"" << entry.reason << "\"\n";
-                out << "  }";
-                if (j < entries_.size() - 1) out << ",";
-                out << "\n";
-            }
-            out << "]\n";
+        auto out = OpenOutput(filename, pool_->size());
+        if (!*out) {
+            std::cerr << "[-] Failed to open output file: " << filename << "\n";
+            continue;
         }
+        targets.emplace_back(fmt, out.get());
+        files.push_back(std::move(out));
+        fileNames.push_back(filename);
+    }
+    WriteEntries(targets, names, directories);
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!CloseOutput(*files[i]))
+            std::cerr << "[-] Failed to write " << fileNames[i] << "\n";
     }
+
+    for (const auto& filename : arrowFiles) {
+        std::ofstream out(filename, std::ios::binary);
+        std::string error;
+        if (!out)
+            std::cerr << "[-] Failed to open output file: " << filename << "\n";
+        else if (!WriteArrowFile(out, entries_, names, directories, error))
+            std::cerr << "[-] Failed to write " << filename << ": " << (error.empty() ? "write error" : error) << "\n";
+    }
+}
+
+// The -o name for the i-th -f format, with the format's extension unless it
+// has one.
+std::string USNJournalReader::OutputFileName(size_t i) const {
+    OutputFormat fmt = outputFormats_[i];
+    std::string filename = (i < outputFiles_.size()) ? outputFiles_[i] : outputFiles_.back();
+    if (filename.find('.') == std::string::npos)
+        filename += "." + GetExtension(fmt);
+    return filename;
+}
+
+// Formats that share a file name are written to it in turn, so the last one
+// is what the file holds; the earlier ones are skipped instead of racing it.
+bool USNJournalReader::OutputShadowed(size_t i) const {
+    std::string filename = OutputFileName(i);
+    for (size_t j = i + 1; j < outputFormats_.size(); ++j)
+        if (OutputFileName(j) == filename)
+            return true;
+    return false;
 }
 
 void USNJournalReader::WriteIndividualToConsole() {
-    for (size_t i = 0; i < outputFormats_.size(); ++i) {
-        OutputFormat fmt = outputFormats_[i];
-        if (fmt == OutputFormat::TXT) {
-            for (const auto& entry : entries_) {
-                std::cout << "Name: " << to_utf8(entry.name) << "\n";
-                std::cout << "Directory: " << to_utf8(entry.directory) << "\n";
-                std::cout << "File ID: " << FileIdToString(entry.fileId) << "\n";
-                std::cout << "USN: " << entry.usn << "\n";
-                std::cout << "Date: " << formatFileTime(entry.date) << "\n";
-                std::cout << "Reason: " << entry.reason << "\n";
-                std::cout << "---\n";
-            }
+    Utf8Cache names(entries_.Names());
+    Utf8Cache directories(entries_.Directories());
+    names.ConvertAll(*pool_);
+    directories.ConvertAll(*pool_);
+    WarmReasonText(entries_);
+
+    // one format after the other, they share the stream
+    for (OutputFormat fmt : outputFormats_) {
+        if (fmt == OutputFormat::ARROW) {
+            std::cerr << "[-] Arrow output needs a file, skipped on the console\n";
+            continue;
         }
-        else if (fmt == OutputFormat::CSV) {
-            std::cout << "Name,Directory,File ID,USN,Date,Reason\n";
-            for (const auto& entry : entries_) {
-                std::cout << "\"" << to_utf8(entry.name) << "\",";
-                std::cout << "\"" << to_utf8(entry.directory) << "\",";
-                std::cout << "\"" << FileIdToString(entry.fileId) << "\",";
-                std::cout << entry.usn << ",";
-                std::cout << "\"" << formatFileTime(entry.date) << "\",";
-                std::cout << "\"" << entry.reason << "\"\n";
+        WriteEntries({ { fmt, &std::cout } }, names, directories);
+    }
+}
+
+// Fills the reason text cache for every reason of store, so ReasonText()
+// only reads it from then on and render threads can share it.
+void USNJournalReader::WarmReasonText(const UsnEntryStore& store) {
+    DWORD last = 0;
+    for (size_t i = 0; i < store.size(); ++i) {
+        if (i == 0 || store.Reason(i) != last)
+            ReasonText(store.Reason(i));
+        last = store.Reason(i);
+    }
+}
+
+// Entries are rendered in ranges of kRenderRange, every target's ranges of a
+// wave in parallel, then each target gets its ranges in order; the targets
+// are written concurrently too. Waves keep the memory to a few ranges per
+// thread whatever the journal size.
+void USNJournalReader::WriteEntries(const std::vector<std::pair<OutputFormat, std::ostream*>>& targets,
+    Utf8Cache& names, Utf8Cache& directories) {
+    const size_t kRenderRange = 8192;
+    size_t rangeCount = std::max<size_t>(1, (entries_.size() + kRenderRange - 1) / kRenderRange);
+    size_t waveSize = pool_->size() * 2;
+    std::vector<OutputBuffer> buffers(targets.size() * std::min(rangeCount, waveSize));
+
+    for (size_t wave = 0; wave < rangeCount; wave += waveSize) {
+        size_t count = std::min(waveSize, rangeCount - wave);
+        pool_->ParallelFor(targets.size() * count, [&](size_t k) {
+            size_t range = wave + k % count;
+            OutputBuffer& out = buffers[k];
+            out.Clear();
+            RenderEntries(out, targets[k / count].first, range * kRenderRange,
+                std::min(entries_.size(), (range + 1) * kRenderRange), names, directories);
+        });
+        pool_->ParallelFor(targets.size(), [&](size_t t) {
+            for (size_t r = 0; r < count; ++r) {
+                std::string_view bytes = buffers[t * count + r].Contents();
+                targets[t].second->write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
             }
+        });
+    }
+}
+
+// Entries [begin, end) in fmt; the first and last range also carry the
+// format's header and footer.
+void USNJournalReader::RenderEntries(OutputBuffer& out, OutputFormat fmt, size_t begin, size_t end,
+    Utf8Cache& names, Utf8Cache& directories) {
+    if (fmt == OutputFormat::TXT) {
+        for (size_t j = begin; j < end; ++j) {
+            out.Append("Name: ");
+            out.Append(names.Get(entries_.NameId(j)));
+            out.Append("\nDirectory: ");
+            out.Append(directories.Get(entries_.DirectoryId(j)));
+            out.Append("\nFile ID: ");
+            out.AppendFileId(entries_.FileKey(j), entries_.WideId(j));
+            out.Append("\nUSN: ");
+            out.AppendNumber(entries_.Usn(j));
+            out.Append("\nDate: ");
+            out.AppendDate(entries_.Date(j));
+            out.Append("\nReason: ");
+            out.Append(ReasonText(entries_.Reason(j)));
+            out.Append("\n---\n");
         }
-        else if (fmt == OutputFormat::JSON) {
-            std::cout << "[\n";
-            for (size_t j = 0; j < entries_.size(); ++j) {
-                const auto& entry = entries_[j];
-                std::cout << "  {\n";
-                std::cout << "    \"name\": \"" << to_utf8(entry.name) << "\",\n";
-                std::cout << "    \"directory\": \"" << to_utf8(entry.directory) << "\",\n";
-                std::cout << "    \"fileId\": \"" << FileIdToString(entry.fileId) << "\",\n";
-                std::cout << "    \"usn\": " << entry.usn << ",\n";
-                std::cout << "    \"date\": \"" << formatFileTime(entry.date) << "\",\n";
-                std::cout << "    \"reason\": \"" << entry.reason << "\"\n";
-                std::cout << "  }";
-                if (j < entries_.size() - 1) std::cout << ",";
-                std::cout << "\n";
-            }
-            std::cout << "]\n";
+    }
+    else if (fmt == OutputFormat::CSV) {
+        if (begin == 0 && !following_)
+            out.Append("Name,Directory,File ID,USN,Date,Reason\n");
+        for (size_t j = begin; j < end; ++j) {
+            out.Append('"');
+            out.Append(names.Get(entries_.NameId(j)));
+            out.Append("\",\"");
+            out.Append(directories.Get(entries_.DirectoryId(j)));
+            out.Append("\",\"");
+            out.AppendFileId(entries_.FileKey(j), entries_.WideId(j));
+            out.Append("\",");
+            out.AppendNumber(entries_.Usn(j));
+            out.Append(",\"");
+            out.AppendDate(entries_.Date(j));
+            out.Append("\",\"");
+            out.Append(ReasonText(entries_.Reason(j)));
+            out.Append("\"\n");
+        }
+    }
+    else if (fmt == OutputFormat::JSON) {
+        if (begin == 0 && !following_)
+            out.Append("[\n");
+        for (size_t j = begin; j < end; ++j) {
+            out.Append("  {\n    \"name\": \"");
+            out.AppendJson(names.Get(entries_.NameId(j)));
+            out.Append("\",\n    \"directory\": \"");
+            out.AppendJson(directories.Get(entries_.DirectoryId(j)));
+            out.Append("\",\n    \"fileId\": \"");
+            out.AppendFileId(entries_.FileKey(j), entries_.WideId(j));
+            out.Append("\",\n    \"usn\": ");
+            out.AppendNumber(entries_.Usn(j));
+            out.Append(",\n    \"date\": \"");
+            out.AppendDate(entries_.Date(j));
+            out.Append("\",\n    \"reason\": \"");
+            out.AppendJson(ReasonText(entries_.Reason(j)));
+            out.Append("\"\n  }");
+            if (j < entries_.size() - 1) out.Append(',');
+            out.Append('\n');
+        }
+        if (end == entries_.size() && !following_)
+            out.Append("]\n");
+    }
+    else if (fmt == OutputFormat::NDJSON) {
+        for (size_t j = begin; j < end; ++j) {
+            out.Append("{\"name\":\"");
+            out.AppendJson(names.Get(entries_.NameId(j)));
+            out.Append("\",\"directory\":\"");
+            out.AppendJson(directories.Get(entries_.DirectoryId(j)));
+            out.Append("\",\"fileId\":\"");
+            out.AppendFileId(entries_.FileKey(j), entries_.WideId(j));
+            out.Append("\",\"usn\":");
+            out.AppendNumber(entries_.Usn(j));
+            out.Append(",\"date\":\"");
+            out.AppendDate(entries_.Date(j));
+            out.Append("\",\"reason\":\"");
+            out.AppendJson(ReasonText(entries_.Reason(j)));
+            out.Append("\"}\n");
         }
     }
 }
 
+// Every format of every kind is its own file, so they are all written at
+// once; a format listed twice is written once.
 void USNJournalReader::WriteReplacesToFile() {
-    auto agg = EventsFileID();
-    size_t copyCount = 0, typeCount = 0, explorerCount = 0;
-
-    if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::COPY) != detectReplaces_.end() ||
-        std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-        copyCount = std::count_if(agg.begin(), agg.end(), [this](const AggregatedUSNEntry& a) { return IsCopyReplacement(a.events); });
-    }
-    if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::TYPE) != detectReplaces_.end() ||
-        std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-        typeCount = std::count_if(agg.begin(), agg.end(), [this](const AggregatedUSNEntry& a) { return IsTypeReplacement(a.events); });
-    }
-    if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::EXPLORER) != detectReplaces_.end() ||
-        std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-        auto allEntries = GetEntriesCopy();
-        std::sort(allEntries.begin(), allEntries.end(),
-            [](const USNEntry& a, const USNEntry& b) {
-                return CompareFileTime(&a.date, &b.date) < 0;
-            });
-        for (size_t i = 0; i < allEntries.size(); ++i) {
-            if (IsExplorerReplacement(allEntries, i)) {
-                explorerCount++;
-                i += 3;
-            }
-        }
+    std::vector<std::pair<OutputFormat, uint32_t>> files;
+    for (size_t i = 0; i < outputFormats_.size(); ++i) {
+        OutputFormat fmt = outputFormats_[i];
+        if (fmt == OutputFormat::ARROW || std::find(outputFormats_.begin() + i + 1, outputFormats_.end(), fmt) != outputFormats_.end())
+            continue;
+        for (uint32_t kind = 0; kind < replaces_.Kinds().size(); ++kind)
+            files.emplace_back(fmt, kind);
     }
 
-    for (const auto& fmt : outputFormats_) {
-        std::string ext = GetExtension(fmt);
-        if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::COPY) != detectReplaces_.end() ||
-            std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-            std::string filename = "copy_replaces." + ext;
-            std::ofstream out(filename);
-            if (!out) {
-                std::wcerr << L"[-] Failed to open copy_replaces file.\n";
-                continue;
-            }
-            WriteReplacesHeader(out, fmt, "Copy", copyCount);
-            size_t index = 0;
-            for (const auto& a : agg) {
-                if (IsCopyReplacement(a.events)) {
-                    WriteReplaceEntry(out, fmt, a, "Copy", ++index == copyCount);
-                }
-            }
-            if (fmt == OutputFormat::JSON) out << "}\n";
+    WarmReasonText(replaces_.Events());
+    pool_->ParallelFor(files.size(), [&](size_t i) {
+        auto [fmt, kind] = files[i];
+        std::string filename = replaces_.Kinds()[kind] + "_replaces." + GetExtension(fmt);
+        auto out = OpenOutput(filename, 1);
+        if (!*out) {
+            std::cerr << "[-] Failed to open " + replaces_.Kinds()[kind] + "_replaces file.\n";
+            return;
         }
+        WriteReplaces(*out, fmt, kind);
+        if (!CloseOutput(*out))
+            std::cerr << "[-] Failed to write " + filename + "\n";
+    });
+}
 
-        if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::TYPE) != detectReplaces_.end() ||
-            std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-            std::string filename = "type_replaces." + ext;
-            std::ofstream out(filename);
-            if (!out) {
-                std::wcerr << L"[-] Failed to open type_replaces file.\n";
-                continue;
-            }
-            WriteReplacesHeader(out, fmt, "Type", typeCount);
-            size_t index = 0;
-            for (const auto& a : agg) {
-                if (IsTypeReplacement(a.events)) {
-                    WriteReplaceEntry(out, fmt, a, "Type", ++index == typeCount);
-                }
-            }
-            if (fmt == OutputFormat::JSON) out << "}\n";
-        }
+// Appends the compression extension to filename. Compressed files are
+// written in binary mode, so their text keeps LF line endings.
+std::unique_ptr<std::ostream> USNJournalReader::OpenOutput(std::string& filename, size_t compressorThreads) const {
+    if (compression_ == Compression::NONE)
+        return std::make_unique<std::ofstream>(filename);
+    filename += CompressionExtension(compression_);
+    return std::make_unique<CompressedOfstream>(filename, compression_, compressorThreads);
+}
 
-        if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::EXPLORER) != detectReplaces_.end() ||
-            std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-            std::string filename = "explorer_replaces." + ext;
-            std::ofstream out(filename);
-            if (!out) {
-                std::wcerr << L"[-] Failed to open explorer_replaces file.\n";
-                continue;
-            }
-            WriteReplacesHeader(out, fmt, "Explorer", explorerCount);
-            auto allEntries = GetEntriesCopy();
-            std::sort(allEntries.begin(), allEntries.end(),
-                [](const USNEntry& a, const USNEntry& b) {
-                    return CompareFileTime(&a.date, &b.date) < 0;
-                });
-            size_t index = 0;
-            for (size_t i = 0; i < allEntries.size(); ++i) {
-                if (IsExplorerReplacement(allEntries, i)) {
-                    WriteExplorerReplaceEntry(out, fmt, allEntries, i, ++index == explorerCount);
-                    i += 3;
-                }
-            }
-            if (fmt == OutputFormat::JSON) out << "}\n";
-        }
-    }
+// Closes a stream of OpenOutput, so the last buffered or compressed block
+// is written. False if any write to it failed.
+bool USNJournalReader::CloseOutput(std::ostream& out) const {
+    if (compression_ != Compression::NONE)
+        return static_cast<CompressedOfstream&>(out).close();
+    auto& file = static_cast<std::ofstream&>(out);
+    file.close();
+    return !file.fail();
 }
 
 void USNJournalReader::WriteReplacesToConsole() {
-    auto agg = EventsFileID();
-    size_t copyCount = 0, typeCount = 0, explorerCount = 0;
-
-    if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::COPY) != detectReplaces_.end() ||
-        std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-        copyCount = std::count_if(agg.begin(), agg.end(), [this](const AggregatedUSNEntry& a) { return IsCopyReplacement(a.events); });
-    }
-    if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::TYPE) != detectReplaces_.end() ||
-        std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-        typeCount = std::count_if(agg.begin(), agg.end(), [this](const AggregatedUSNEntry& a) { return IsTypeReplacement(a.events); });
-    }
-    if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::EXPLORER) != detectReplaces_.end() ||
-        std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-        auto allEntries = GetEntriesCopy();
-        std::sort(allEntries.begin(), allEntries.end(),
-            [](const USNEntry& a, const USNEntry& b) {
-                return CompareFileTime(&a.date, &b.date) < 0;
-            });
-        for (size_t i = 0; i < allEntries.size(); ++i) {
-            if (IsExplorerReplacement(allEntries, i)) {
-                explorerCount++;
-                i += 3;
-            }
-        }
-    }
-
     for (const auto& fmt : outputFormats_) {
-        if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::COPY) != detectReplaces_.end() ||
-            std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-            WriteReplacesHeader(std::cout, fmt, "Copy", copyCount);
-            size_t index = 0;
-            for (const auto& a : agg) {
-                if (IsCopyReplacement(a.events)) {
-                    WriteReplaceEntry(std::cout, fmt, a, "Copy", ++index == copyCount);
-                }
-            }
-            if (fmt == OutputFormat::JSON) std::cout << "}\n";  // Close JSON object
-        }
+        if (fmt == OutputFormat::ARROW)
+            continue;
+        for (uint32_t kind = 0; kind < replaces_.Kinds().size(); ++kind)
+            WriteReplaces(std::cout, fmt, kind);
+    }
+}
 
-        if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::TYPE) != detectReplaces_.end() ||
-            std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-            WriteReplacesHeader(std::cout, fmt, "Type", typeCount);
-            size_t index = 0;
-            for (const auto& a : agg) {
-                if (IsTypeReplacement(a.events)) {
-                    WriteReplaceEntry(std::cout, fmt, a, "Type", ++index == typeCount);
-                }
-            }
-            if (fmt == OutputFormat::JSON) std::cout << "}\n";
-        }
+void USNJournalReader::WriteReplaces(std::ostream& out, OutputFormat fmt, uint32_t kind) {
+    std::string title = replaces_.Kinds()[kind];
+    title[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(title[0])));
+    size_t count = replaces_.Count(kind);
 
-        if (std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::EXPLORER) != detectReplaces_.end() ||
-            std::find(detectReplaces_.begin(), detectReplaces_.end(), ReplaceType::ALL) != detectReplaces_.end()) {
-            WriteReplacesHeader(std::cout, fmt, "Explorer", explorerCount);
-            auto allEntries = GetEntriesCopy();
-            std::sort(allEntries.begin(), allEntries.end(),
-                [](const USNEntry& a, const USNEntry& b) {
-                    return CompareFileTime(&a.date, &b.date) < 0;
-                });
-            size_t index = 0;
-            for (size_t i = 0; i < allEntries.size(); ++i) {
-                if (IsExplorerReplacement(allEntries, i)) {
-                    WriteExplorerReplaceEntry(std::cout, fmt, allEntries, i, ++index == explorerCount);
-                    i += 3;
-                }
-            }
-            if (fmt == OutputFormat::JSON) std::cout << "}\n";
-        }
+    WriteReplacesHeader(out, fmt, title, count);
+    size_t index = 0;
+    for (const auto& match : replaces_.Matches()) {
+        if (match.kind != kind)
+            continue;
+        if (replaces_.IsExplorer(kind))
+            WriteExplorerReplaceEntry(out, fmt, match, ++index == count);
+        else
+            WriteReplaceEntry(out, fmt, match, title, ++index == count);
     }
+    if (fmt == OutputFormat::JSON) out << "  ]\n}\n";
 }
 
 std::string USNJournalReader::GetExtension(OutputFormat fmt) const {
@@ -753,6 +1385,8 @@ std::string USNJournalReader::GetExtension(OutputFormat fmt) const {
     case OutputFormat::TXT: return "txt";
     case OutputFormat::CSV: return "csv";
     case OutputFormat::JSON: return "json";
+    case OutputFormat::NDJSON: return "ndjson";
+    case OutputFormat::ARROW: return "arrow";
     default: return "txt";
     }
 }
@@ -765,70 +1399,85 @@ void USNJournalReader::WriteReplacesHeader(std::ostream& out, OutputFormat fmt,
         out << "Type,Name,Directory,File ID,Replace\n";
     }
     else if (fmt == OutputFormat::JSON) {
-        out << "{\n  \"type\": \"" << type << "\",\n  \"count\": " << count << ",\n  \"entries\": [\n";
+        out << "{\n  \"type\": \"" << JsonEscape(type) << "\",\n  \"count\": " << count << ",\n  \"entries\": [\n";
     }
 }
 
-void USNJournalReader::WriteReplaceEntry(std::ostream& out, OutputFormat fmt, const AggregatedUSNEntry& a, const std::string& replaceType, bool isLast) {
+void USNJournalReader::WriteReplaceEntry(std::ostream& out, OutputFormat fmt, const ReplaceMatch& match, const std::string& replaceType, bool isLast) {
+    const UsnEntryStore& events = replaces_.Events();
+    size_t lastEvent = match.first + match.count - 1;
+    std::string name = to_utf8(events.Name(lastEvent));
+    std::string directory = to_utf8(events.Directory(lastEvent));
+    std::string fileId = FileIdToString(events.FileId(lastEvent));
     if (fmt == OutputFormat::TXT) {
-        out << "Name: " << to_utf8(a.name) << "\n";
-        out << "Directory: " << to_utf8(a.directory) << "\n";
-        out << "File ID: " << FileIdToString(a.fileId) << "\n";
+        out << "Name: " << name << "\n";
+        out << "Directory: " << directory << "\n";
+        out << "File ID: " << fileId << "\n";
         out << "Replace: " << replaceType << "\n";
         out << "Events:\n";
-        for (const auto& e : a.events) {
-            out << "  Date: " << formatFileTime(e.date) << " | Reason: " << e.reason
-                << " | Directory: " << to_utf8(e.directory) << "\n";
+        for (size_t e = match.first; e <= lastEvent; ++e) {
+            out << "  Date: " << formatFileTime(events.Date(e)) << " | Reason: " << ReasonText(events.Reason(e))
+                << " | Directory: " << to_utf8(events.Directory(e)) << "\n";
         }
         out << "---\n";
     }
     else if (fmt == OutputFormat::CSV) {
         out << "\"" << replaceType << "\",";
-        out << "\"" << to_utf8(a.name) << "\",";
-        out << "\"" << to_utf8(a.directory) << "\",";
-        out << "\"" << FileIdToString(a.fileId) << "\",";
+        out << "\"" << name << "\",";
+        out << "\"" << directory << "\",";
+        out << "\"" << fileId << "\",";
         out << "\"" << replaceType << "\"\n";
     }
     else if (fmt == OutputFormat::JSON) {
         out << "    {\n";
-        out << "      \"name\": \"" << to_utf8(a.name) << "\",\n";
-        out << "      \"directory\": \"" << to_utf8(a.directory) << "\",\n";
-        out << "      \"fileId\": \"" << FileIdToString(a.fileId) << "\",\n";
-        out << "      \"replace\": \"" << replaceType << "\"\n";
+        out << "      \"name\": \"" << JsonEscape(name) << "\",\n";
+        out << "      \"directory\": \"" << JsonEscape(directory) << "\",\n";
+        out << "      \"fileId\": \"" << fileId << "\",\n";
+        out << "      \"replace\": \"" << JsonEscape(replaceType) << "\"\n";
         out << "    }";
         if (!isLast) out << ",";
         out << "\n";
     }
+    else if (fmt == OutputFormat::NDJSON) {
+        out << "{\"name\":\"" << JsonEscape(name) << "\",\"directory\":\"" << JsonEscape(directory)
+            << "\",\"fileId\":\"" << fileId << "\",\"replace\":\"" << JsonEscape(replaceType) << "\"}\n";
+    }
 }
 
-void USNJournalReader::WriteExplorerReplaceEntry(std::ostream& out, OutputFormat fmt, const std::vector<USNEntry>& allEntries, size_t startIndex, bool isLast) {
-    const auto& lastEvent = allEntries[startIndex + 3];
+void USNJournalReader::WriteExplorerReplaceEntry(std::ostream& out, OutputFormat fmt, const ReplaceMatch& match, bool isLast) {
+    const UsnEntryStore& events = replaces_.Events();
+    size_t lastEvent = match.first + match.count - 1;
+    std::string name = to_utf8(events.Name(lastEvent));
+    std::string directory = to_utf8(events.Directory(lastEvent));
     if (fmt == OutputFormat::TXT) {
-        out << "Name: " << to_utf8(lastEvent.name) << "\n";
-        out << "Directory: " << to_utf8(lastEvent.directory) << "\n";
+        out << "Name: " << name << "\n";
+        out << "Directory: " << directory << "\n";
         out << "Replace: Explorer\n";
         out << "Events:\n";
-        for (size_t j = 0; j < 4; ++j) {
-            const auto& e = allEntries[startIndex + j];
-            out << "  Date: " << formatFileTime(e.date) << " | Reason: " << e.reason
-                << " | Directory: " << to_utf8(e.directory) << "\n";
+        for (size_t e = match.first; e <= lastEvent; ++e) {
+            out << "  Date: " << formatFileTime(events.Date(e)) << " | Reason: " << ReasonText(events.Reason(e))
+                << " | Directory: " << to_utf8(events.Directory(e)) << "\n";
         }
         out << "---\n";
     }
     else if (fmt == OutputFormat::CSV) {
         out << "\"Explorer\",";
-        out << "\"" << to_utf8(lastEvent.name) << "\",";
-        out << "\"" << to_utf8(lastEvent.directory) << "\",";
+        out << "\"" << name << "\",";
+        out << "\"" << directory << "\",";
         out << "\"\",";
         out << "\"Explorer\"\n";
     }
     else if (fmt == OutputFormat::JSON) {
         out << "    {\n";
-        out << "      \"name\": \"" << to_utf8(lastEvent.name) << "\",\n";
-        out << "      \"directory\": \"" << to_utf8(lastEvent.directory) << "\",\n";
+        out << "      \"name\": \"" << JsonEscape(name) << "\",\n";
+        out << "      \"directory\": \"" << JsonEscape(directory) << "\",\n";
         out << "      \"replace\": \"Explorer\"\n";
         out << "    }";
         if (!isLast) out << ",";
         out << "\n";
     }
+    else if (fmt == OutputFormat::NDJSON) {
+        out << "{\"name\":\"" << JsonEscape(name) << "\",\"directory\":\"" << JsonEscape(directory)
+            << "\",\"replace\":\"Explorer\"}\n";
+    }
 }
\ No newline at end of file
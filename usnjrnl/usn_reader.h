@@ -1,68 +1,177 @@
-#pragma once
-
-#include "usn_structs.h"
-#include "usn_patterns.h"
-#include <string>
-#include <vector>
-#include <unordered_map>
-#include <mutex>
-#include <memory>
-
-class USNJournalReader {
-public:
-    USNJournalReader(const std::wstring& volumeLetter);
-
-    bool filterAfterLogon_ = false;
-    time_t logonTime_ = 0;
-    bool filterAfterDate_ = false;
-    time_t filterDate_ = 0;
-    std::vector<std::string> filterNames_;
-    std::vector<std::string> filterReasons_;
-    std::vector<std::string> filterIds_;
-    std::vector<std::string> filterPaths_;
-    bool filterPathRecursive_ = false;
-    std::vector<ReplaceType> detectReplaces_;
-    std::vector<OutputFormat> outputFormats_ = { OutputFormat::TXT };
-    std::vector<std::string> outputFiles_ = { "usnjrnl.txt" };
-    bool consoleOutput_ = false;
-    bool onlyReplace_ = false;
-
-    void Run();
-    std::vector<USNEntry> GetEntriesCopy();
-    std::vector<AggregatedUSNEntry> EventsFileID();
-    void EnableAfterLogonFilter(time_t logonTime);
-
-private:
-    std::wstring volumeLetter_;
-    HANDLE volumeHandle_ = INVALID_HANDLE_VALUE;
-    std::unique_ptr<BYTE[]> buffer_;
-    USN_JOURNAL_DATA_V0 journalData_{};
-    std::unordered_map<FileIdVariant, std::wstring, FileIdHash, FileIdEqual> pathCache_;
-    std::mutex cacheMutex_;
-    std::mutex entriesMutex_;
-    std::vector<USNEntry> entries_;
-
-    std::string FileIdToString(const FileIdVariant& fid);
-    bool Dump();
-    bool OpenVolume();
-    bool QueryJournal();
-    bool AllocateBuffer();
-    std::wstring GetDirectoryById(ULONGLONG fileId);
-    std::wstring GetDirectoryById(const FILE_ID_128& fileId128);
-    std::string ReasonToString(DWORD reason) const;
-    bool CheckPatternSequential(const std::vector<std::string>& window, const std::vector<std::vector<std::string>>& pattern);
-    bool IsCopyReplacement(const std::vector<FileEvent>& events);
-    bool IsTypeReplacement(const std::vector<FileEvent>& events);
-    bool IsExplorerReplacement(const std::vector<USNEntry>& orderedEntries, size_t startIndex);
-    void PushEntry(FileIdVariant fileId, ULONGLONG usn, const std::wstring& name, const FILETIME& date, const std::string& reason, const std::wstring& dir);
-    void Cleanup();
-
-    void WriteIndividualToFile();
-    void WriteIndividualToConsole();
-    void WriteReplacesToFile();
-    void WriteReplacesToConsole();
-    std::string GetExtension(OutputFormat fmt) const;
-    void WriteReplacesHeader(std::ostream& out, OutputFormat fmt, const std::string& type, size_t count);
-    void WriteReplaceEntry(std::ostream& out, OutputFormat fmt, const AggregatedUSNEntry& a, const std::string& replaceType, bool isLast);
-    void WriteExplorerReplaceEntry(std::ostream& out, OutputFormat fmt, const std::vector<USNEntry>& allEntries, size_t startIndex, bool isLast);
+#pragma once
+
+#include "usn_structs.h"
+#include "usn_record.h"
+#include "usn_patterns.h"
+#include "usn_thread_pool.h"
+#include "usn_entry_store.h"
+#include "usn_path_resolver.h"
+#include "usn_mft_index.h"
+#include "usn_filters.h"
+#include "usn_name_matcher.h"
+#include "usn_file_id.h"
+#include "usn_path_filter.h"
+#include "usn_aggregate.h"
+#include "usn_replace_detector.h"
+#include "usn_replace_patterns.h"
+#include "usn_output.h"
+#include "usn_arrow.h"
+#include "usn_compress.h"
+#include "usn_state.h"
+#include "usn_source.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <tuple>
+
+class USNJournalReader {
+public:
+    USNJournalReader(const std::wstring& volumeLetter);
+
+    std::string journalFile_;
+    std::string mftFile_;
+    size_t threads_ = 0;
+    bool filterAfterLogon_ = false;
+    time_t logonTime_ = 0;
+    bool filterAfterDate_ = false;
+    time_t filterDate_ = 0;
+    std::vector<std::string> filterNames_;
+    bool filterNamesIgnoreCase_ = false;
+    std::vector<std::string> filterReasons_;
+    std::vector<std::string> filterIds_;
+    bool filterIdsBySegment_ = false;
+    std::vector<std::string> filterPaths_;
+    std::vector<std::string> filterPathExcludes_;
+    bool filterPathRecursive_ = false;
+    std::vector<ReplaceType> detectReplaces_;
+    std::string patternFile_;
+    std::string stateFile_;
+    std::vector<OutputFormat> outputFormats_ = { OutputFormat::TXT };
+    std::vector<std::string> outputFiles_ = { "usnjrnl.txt" };
+    bool consoleOutput_ = false;
+    bool onlyReplace_ = false;
+    bool follow_ = false;
+    std::string replayFile_;
+    double replayRate_ = 0;   // records per second, 0 = as fast as possible
+    Compression compression_ = Compression::NONE;
+
+    // False if the options or the journal couldn't be read.
+    bool Run();
+    std::vector<USNEntry> GetEntriesCopy();
+    std::vector<AggregatedUSNEntry> EventsFileID();
+    void EnableAfterLogonFilter(time_t logonTime);
+
+    // Records walked by the last Run, accepted or filtered out.
+    size_t RecordsRead() const { return acceptedRecords_ + filterCounters_.Total(); }
+
+private:
+    friend class ReaderMicroBench;  // tools/usn_microbench.cpp times the private stages
+
+    std::wstring volumeLetter_;
+    HANDLE volumeHandle_ = INVALID_HANDLE_VALUE;
+    std::unique_ptr<BYTE[]> buffer_;
+    USN_JOURNAL_DATA_V0 journalData_{};
+    std::unordered_map<FileIdVariant, UsnString, FileIdHash, FileIdEqual> pathCache_;
+    std::mutex cacheMutex_;
+    std::mutex entriesMutex_;
+    UsnEntryStore entries_;
+    std::vector<DirectoryChange> directoryChanges_;
+    std::unique_ptr<ThreadPool> pool_;
+    std::unique_ptr<MftIndex> mft_;
+    FilterCounters filterCounters_;
+    NameMatcher nameMatcher_;
+    FileIdSet idFilter_;
+    PathFilter pathFilter_;
+    FileAggregation aggregation_;
+    bool aggregated_ = false;
+    ReplaceDetector replaces_;
+    bool keepEntries_ = true;  // false when only replaces are written and none need the full list
+    size_t acceptedRecords_ = 0;
+    ULONGLONG timeThreshold_ = 0;  // UTC ticks, 0 = no time filter
+    DWORD filterReasonMask_ = 0;
+    bool filterReasonUnknown_ = false;
+    std::unordered_map<DWORD, std::string> reasonText_;
+
+    // Where reading stopped, kept in stateFile_ between runs.
+    struct Checkpoint {
+        ULONGLONG journalId = 0;   // UsnJournalID, 0 for a $J file
+        USN nextUsn = 0;           // live: first USN not read yet
+        ULONGLONG nextOffset = 0;  // $J file: where parsing resumes, 0 = from the start
+        ULONGLONG lastOffset = 0;  // $J file: the last record read, which must still
+        ULONGLONG lastUsn = 0;     // be there with this USN for the file to match
+    };
+    Checkpoint checkpoint_;
+    std::vector<DirectoryChange> savedDirectories_;  // resolver links of the last run
+    std::vector<DirectoryChange> directoryLinks_;    // and of this one, to save
+    const BYTE* lastRecord_ = nullptr;               // last record walked in a $J file
+    bool following_ = false;  // batches of --follow: no headers or footers
+
+    // What one parse walk produces; chunks fill their own and are merged in order.
+    struct ParsedRecords {
+        UsnEntryStore entries;
+        std::vector<DirectoryChange> directories;
+        FilterCounters rejected;
+        const BYTE* lastRecord = nullptr;  // start of the last valid record walked
+
+        void clear() { *this = ParsedRecords(); }
+    };
+
+    std::string FileIdToString(const FileIdVariant& fid);
+    bool Prepare();
+    bool Dump();
+    bool DumpFile();
+    void ParseRange(const BYTE* begin, const BYTE* end, bool rawStream);
+    const BYTE* ParseRecords(const BYTE* ptr, const BYTE* stop, const BYTE* end, bool rawStream, ParsedRecords& out);
+    const BYTE* FindRecordStart(const BYTE* ptr, const BYTE* stop, const BYTE* end) const;
+    bool CollectDirectories(const BYTE* ptr, const BYTE* end, bool rawStream, USN stopUsn);
+    void CollectVolumeDirectories(USN from, USN to);
+    const BYTE* SeekToTime(const BYTE* begin, const BYTE* end) const;
+    USN SeekUsnToTime();
+    void ProcessRecord(const UsnRecordView& rec, ParsedRecords& out);
+    FilterStage FilterRecord(const UsnRecordView& rec, UsnStringView name);
+    bool LoadMft();
+    void FeedReplaceDetector(ParsedRecords& parsed);
+    void ResolveDirectories();
+    void ResolveDirectories(UsnEntryStore& store, size_t DirectoryChange::*position);
+    JournalPathResolver SeededResolver();
+    bool LoadState(const std::function<const char*(const Checkpoint&)>& check);
+    void SaveState();
+    bool OpenVolume();
+    bool QueryJournal();
+    bool AllocateBuffer();
+    UsnString GetDirectoryById(ULONGLONG fileId);
+    UsnString GetDirectoryById(const FILE_ID_128& fileId128);
+    UsnString GetDirectoryById(const FileIdVariant& fileId);
+    std::string ReasonToString(DWORD reason) const;
+    const std::string& ReasonText(DWORD reason);
+    bool PrepareFilters();
+    const FileAggregation& Aggregation();
+    bool DetectsReplace(ReplaceType type) const;
+    void Cleanup();
+
+    void Follow();
+    std::unique_ptr<JournalSource> OpenFollowSource();
+    void FollowBatch(ParsedRecords& parsed, JournalPathResolver& resolver,
+        const std::vector<std::pair<OutputFormat, std::ostream*>>& entryTargets,
+        const std::vector<std::tuple<OutputFormat, uint32_t, std::ostream*>>& replaceTargets);
+
+    std::string OutputFileName(size_t format) const;
+    bool OutputShadowed(size_t format) const;
+    void WriteIndividualToFile();
+    void WriteIndividualToConsole();
+    void WriteEntries(const std::vector<std::pair<OutputFormat, std::ostream*>>& targets, Utf8Cache& names, Utf8Cache& directories);
+    void RenderEntries(OutputBuffer& out, OutputFormat fmt, size_t begin, size_t end, Utf8Cache& names, Utf8Cache& directories);
+    void WarmReasonText(const UsnEntryStore& store);
+    void WriteReplacesToFile();
+    void WriteReplacesToConsole();
+    std::unique_ptr<std::ostream> OpenOutput(std::string& filename, size_t compressorThreads) const;
+    bool CloseOutput(std::ostream& out) const;
+    void WriteReplaces(std::ostream& out, OutputFormat fmt, uint32_t kind);
+    std::string GetExtension(OutputFormat fmt) const;
+    void WriteReplacesHeader(std::ostream& out, OutputFormat fmt, const std::string& type, size_t count);
+    void WriteReplaceEntry(std::ostream& out, OutputFormat fmt, const ReplaceMatch& match, const std::string& replaceType, bool isLast);
+    void WriteExplorerReplaceEntry(std::ostream& out, OutputFormat fmt, const ReplaceMatch& match, bool isLast);
 };
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "usn_structs.h"
+
+// Decoded header fields of a single USN record. Nothing is copied out of the
+// record: name points straight into the buffer or mapping it was parsed from.
+struct UsnRecordView {
+    WORD majorVersion = 0;
+    DWORD recordLength = 0;
+    FileIdVariant fileId{ 0ULL };
+    FileIdVariant parentId{ 0ULL };
+    ULONGLONG usn = 0;
+    FILETIME timeStamp{};
+    DWORD reason = 0;
+    DWORD fileAttributes = 0;
+    UsnStringView name;
+
+    // timeStamp as one raw UTC tick count, zero for V4 records
+    ULONGLONG Ticks() const {
+        return (static_cast<ULONGLONG>(timeStamp.dwHighDateTime) << 32) | timeStamp.dwLowDateTime;
+    }
+};
+
+// Validates the record at ptr against the bytes available and fills view.
+// Raw $J streams contain zero padding and garbage between valid records, so
+// every length and offset is checked before anything is dereferenced.
+inline bool ParseUsnRecord(const BYTE* ptr, size_t avail, UsnRecordView& view) {
+    if (avail < sizeof(USN_RECORD_COMMON_HEADER))
+        return false;
+
+    auto common = reinterpret_cast<const USN_RECORD_COMMON_HEADER*>(ptr);
+    DWORD length = common->RecordLength;
+    if (length < sizeof(USN_RECORD_COMMON_HEADER) || length > avail || (length & 7) != 0)
+        return false;
+
+    view.majorVersion = common->MajorVersion;
+    view.recordLength = length;
+
+    if (common->MajorVersion == 2) {
+        if (length < offsetof(USN_RECORD_V2, FileName))
+            return false;
+        auto rec = reinterpret_cast<const USN_RECORD_V2*>(ptr);
+        if ((DWORD)rec->FileNameOffset + rec->FileNameLength > length || (rec->FileNameOffset & 1) != 0)
+            return false;
+        view.fileId = (ULONGLONG)rec->FileReferenceNumber;
+        view.parentId = (ULONGLONG)rec->ParentFileReferenceNumber;
+        view.usn = rec->Usn;
+        view.timeStamp.dwLowDateTime = rec->TimeStamp.LowPart;
+        view.timeStamp.dwHighDateTime = rec->TimeStamp.HighPart;
+        view.reason = rec->Reason;
+        view.fileAttributes = rec->FileAttributes;
+        view.name = UsnStringView(reinterpret_cast<const WCHAR*>(ptr + rec->FileNameOffset),
+            rec->FileNameLength / sizeof(WCHAR));
+        return true;
+    }
+    if (common->MajorVersion == 3) {
+        if (length < offsetof(USN_RECORD_V3, FileName))
+            return false;
+        auto rec = reinterpret_cast<const USN_RECORD_V3*>(ptr);
+        if ((DWORD)rec->FileNameOffset + rec->FileNameLength > length || (rec->FileNameOffset & 1) != 0)
+            return false;
+        view.fileId = rec->FileReferenceNumber;
+        view.parentId = rec->ParentFileReferenceNumber;
+        view.usn = rec->Usn;
+        view.timeStamp.dwLowDateTime = rec->TimeStamp.LowPart;
+        view.timeStamp.dwHighDateTime = rec->TimeStamp.HighPart;
+        view.reason = rec->Reason;
+        view.fileAttributes = rec->FileAttributes;
+        view.name = UsnStringView(reinterpret_cast<const WCHAR*>(ptr + rec->FileNameOffset),
+            rec->FileNameLength / sizeof(WCHAR));
+        return true;
+    }
+    if (common->MajorVersion == 4) {
+        if (length < offsetof(USN_RECORD_V4, Extents))
+            return false;
+        auto rec = reinterpret_cast<const USN_RECORD_V4*>(ptr);
+        view.fileId = rec->FileReferenceNumber;
+        view.parentId = rec->ParentFileReferenceNumber;
+        view.usn = rec->Usn;
+        view.timeStamp = {};
+        view.reason = rec->Reason;
+        view.fileAttributes = 0;
+        view.name = {};
+        return true;
+    }
+
+    return false;
+}
+// Stricter check used to resynchronise in the middle of a stream: besides being
+// parseable, the record length must be exactly what its name or extents need,
+// which random bytes inside another record's name practically never satisfy.
+inline bool IsRecordStart(const BYTE* ptr, size_t avail) {
+    UsnRecordView view;
+    if (!ParseUsnRecord(ptr, avail, view))
+        return false;
+
+    auto align8 = [](size_t n) { return (n + 7) & ~size_t(7); };
+    if (view.majorVersion == 2) {
+        auto rec = reinterpret_cast<const USN_RECORD_V2*>(ptr);
+        return rec->FileNameOffset == offsetof(USN_RECORD_V2, FileName) && rec->FileNameLength > 0 &&
+            view.recordLength == align8(rec->FileNameOffset + rec->FileNameLength);
+    }
+    if (view.majorVersion == 3) {
+        auto rec = reinterpret_cast<const USN_RECORD_V3*>(ptr);
+        return rec->FileNameOffset == offsetof(USN_RECORD_V3, FileName) && rec->FileNameLength > 0 &&
+            view.recordLength == align8(rec->FileNameOffset + rec->FileNameLength);
+    }
+    auto rec = reinterpret_cast<const USN_RECORD_V4*>(ptr);
+    return rec->ExtentSize == sizeof(USN_RECORD_EXTENT) &&
+        view.recordLength == align8(offsetof(USN_RECORD_V4, Extents) + (size_t)rec->NumberOfExtents * rec->ExtentSize);
+}
\ No newline at end of file
@@ -0,0 +1,397 @@
+#include "usn_replace_detector.h"
+#include "usn_patterns.h"
+#include "usn_hash.h"
+#include <algorithm>
+#include <bit>
+
+void ReplaceDetector::Configure(const std::vector<ReplacePatternDef>& patterns, bool explorer) {
+    *this = ReplaceDetector();
+    for (const auto& def : patterns) {
+        auto kind = std::find(kinds_.begin(), kinds_.end(), def.kind);
+        if (kind == kinds_.end())
+            kind = kinds_.insert(kinds_.end(), def.kind);
+        patterns_.push_back({ static_cast<uint32_t>(kind - kinds_.begin()), static_cast<uint32_t>(def.steps.size()), !def.names.empty() });
+        names_.emplace_back().Compile(def.names, true);
+        window_ = std::max(window_, def.steps.size() - 1);
+
+        signature_ += def.kind + '\n';
+        for (DWORD step : def.steps)
+            signature_ += std::to_string(step) + '>';
+        for (const auto& name : def.names)
+            signature_ += name + ';';
+        signature_ += std::to_string(def.maxGap) + '\n';
+    }
+    if (explorer) {
+        signature_ += "explorer\n";
+        explorerKind_ = static_cast<uint32_t>(kinds_.size());
+        kinds_.push_back("explorer");
+    }
+    reported_.resize(kinds_.size());
+    automaton_.Compile(patterns);
+}
+
+void ReplaceDetector::Push(const UsnEntryStore& store, size_t i) {
+    if (explorerKind_ != kNoKind)
+        PushExplorer(store, i);
+    if (!patterns_.empty())
+        PushFile(store, i);
+}
+
+// A match is four records in a row with one name, the delete of the old file
+// and the rename of the new one over it. The records of a match are not
+// reused for the next one.
+void ReplaceDetector::PushExplorer(const UsnEntryStore& store, size_t i) {
+    const size_t ring = kExplorerLength - 1;
+    UsnStringView name = store.Name(i);
+    uint64_t nameHash = HashBytes(name.data(), name.size() * sizeof(WCHAR));
+    DWORD reason = store.Reason(i);
+
+    uint32_t directoryId = UsnEntryStore::kPendingDirectory;
+    if (store.DirectoryId(i) != UsnEntryStore::kPendingDirectory)
+        directoryId = events_.InternDirectory(store.Directory(i));
+    Event event{ store.Usn(i), store.Date(i), reason, store.ParentKey(i), directoryId };
+
+    if (explorerCount_ == ring && (reason & EXPLORER_PATTERN[ring]) == EXPLORER_PATTERN[ring]) {
+        auto at = [&](size_t j) -> const Recent& { return explorer_[(explorerHead_ + j) % ring]; };
+        bool sameName = true;
+        for (size_t j = 0; j < ring && sameName; ++j)
+            sameName = at(j).nameHash == nameHash && at(j).name == name;
+
+        if (sameName && CheckPatternSequential(EXPLORER_PATTERN, [&](size_t j) { return j < ring ? at(j).event.reason : reason; })) {
+            uint32_t first = static_cast<uint32_t>(events_.size());
+            for (size_t j = 0; j < ring; ++j) {
+                const Recent& r = at(j);
+                events_.Append(r.event.usn, r.event.date, r.event.reason, MakeFileIdVariant(r.file, r.wideId),
+                    MakeFileIdVariant(r.event.parent, r.wideId), r.name, r.event.directoryId);
+            }
+            events_.Append(event.usn, event.date, event.reason, store.FileId(i), store.ParentId(i), name, directoryId);
+            matches_.push_back({ explorerKind_, first, static_cast<uint32_t>(kExplorerLength) });
+            explorerCount_ = 0;
+            explorerHead_ = 0;
+            return;
+        }
+    }
+
+    // the ring's strings keep their buffers, so this rarely allocates
+    size_t slot = (explorerHead_ + explorerCount_) % ring;
+    if (explorerCount_ == ring)
+        explorerHead_ = (explorerHead_ + 1) % ring;
+    else
+        ++explorerCount_;
+    Recent& r = explorer_[slot];
+    r.event = event;
+    r.file = store.FileKey(i);
+    r.wideId = store.WideId(i);
+    r.nameHash = nameHash;
+    r.name.assign(name);
+}
+
+void ReplaceDetector::PushFile(const UsnEntryStore& store, size_t i) {
+    const size_t words = automaton_.Words();
+    const uint64_t* accepts = automaton_.Accepts(store.Reason(i));
+    const uint64_t* initial = automaton_.Initial();
+    const uint64_t* final = automaton_.Final();
+
+    bool anyStep = false;
+    bool starts = false;
+    for (size_t w = 0; w < words; ++w) {
+        anyStep |= accepts[w] != 0;
+        starts |= (accepts[w] & initial[w]) != 0;
+    }
+
+    FileIdKey key = store.FileKey(i);
+    uint32_t index = count_ ? Find(key) : 0;
+    if (index == 0) {
+        // only a record that starts some pattern opens a file
+        if (!starts)
+            return;
+        index = Insert(key);
+        states_[index - 1].wideId = store.WideId(i);
+    }
+    else if (!anyStep) {
+        Erase(key);
+        return;
+    }
+    FileState& state = states_[index - 1];
+    uint64_t* mask = words_.data() + (index - 1) * words;
+
+    uint32_t directoryId = UsnEntryStore::kPendingDirectory;
+    if (store.DirectoryId(i) != UsnEntryStore::kPendingDirectory)
+        directoryId = events_.InternDirectory(store.Directory(i));
+    Event event{ store.Usn(i), store.Date(i), store.Reason(i), store.ParentKey(i), directoryId };
+
+    ULONGLONG date = (ULONGLONG(event.date.dwHighDateTime) << 32) | event.date.dwLowDateTime;
+    if (date > state.lastDate)
+        automaton_.Expire(mask, date - state.lastDate);
+    state.lastDate = date;
+
+    // Final bits are cleared once reported, so a finished pattern never
+    // carries into the first step of the next one.
+    bool pending = false;
+    uint64_t carry = 0;
+    for (size_t w = 0; w < words; ++w) {
+        uint64_t next = ((mask[w] << 1) | carry | initial[w]) & accepts[w];
+        carry = mask[w] >> 63;
+        for (uint64_t done = next & final[w]; done; done &= done - 1) {
+            uint32_t p = automaton_.PatternAt(w * 64 + std::countr_zero(done));
+            const Pattern& pattern = patterns_[p];
+            UsnStringView name = store.Name(i);
+            if (!reported_[pattern.kind].Contains(key) && (!pattern.named || names_[p].Matches(name))) {
+                reported_[pattern.kind].Insert(key);
+                Report(pattern.kind, index, pattern.length, event, key, name);
+            }
+        }
+        mask[w] = next & ~final[w];
+        pending |= mask[w] != 0;
+    }
+
+    if (!pending || (event.reason & USN_REASON_FILE_DELETE)) {
+        Erase(key);
+        return;
+    }
+
+    recent_[(index - 1) * window_ + state.head] = event;
+    state.head = static_cast<uint32_t>((state.head + 1) % window_);
+}
+
+// The match is the length - 1 most recent events of the file and last.
+void ReplaceDetector::Report(uint32_t kind, uint32_t index, size_t length, const Event& last, FileIdKey file, UsnStringView name) {
+    const FileState& state = states_[index - 1];
+    const Event* recent = recent_.data() + (index - 1) * window_;
+    FileIdVariant fileId = MakeFileIdVariant(file, state.wideId);
+    auto append = [&](const Event& event) {
+        events_.Append(event.usn, event.date, event.reason, fileId, MakeFileIdVariant(event.parent, state.wideId),
+            name, event.directoryId);
+    };
+
+    uint32_t first = static_cast<uint32_t>(events_.size());
+    for (size_t k = length - 1; k > 0; --k)
+        append(recent[(state.head + window_ - k) % window_]);
+    append(last);
+    matches_.push_back({ kind, first, static_cast<uint32_t>(length) });
+}
+
+void ReplaceDetector::Save(StateWriter& out) const {
+    out.PutString(signature_);
+
+    const size_t ring = kExplorerLength - 1;
+    out.Put<uint64_t>(explorerCount_);
+    for (size_t j = 0; j < explorerCount_; ++j) {
+        const Recent& r = explorer_[(explorerHead_ + j) % ring];
+        SaveEvent(out, r.event);
+        out.Put(r.file);
+        out.Put<uint8_t>(r.wideId);
+        out.PutString(r.name);
+    }
+
+    const size_t words = automaton_.Words();
+    out.Put<uint64_t>(count_);
+    for (const Slot& slot : slots_) {
+        if (slot.state == 0)
+            continue;
+        const FileState& state = states_[slot.state - 1];
+        out.Put(slot.key);
+        out.Put(state.head);
+        out.Put<uint8_t>(state.wideId);
+        out.Put(state.lastDate);
+        for (size_t w = 0; w < words; ++w)
+            out.Put(words_[(slot.state - 1) * words + w]);
+        for (size_t k = 0; k < window_; ++k)
+            SaveEvent(out, recent_[(slot.state - 1) * window_ + k]);
+    }
+
+    for (const FileIdSet& reported : reported_) {
+        out.Put<uint64_t>(reported.size());
+        reported.ForEach([&](FileIdKey key) { out.Put(key); });
+    }
+}
+
+// Reads everything before changing anything, so a mismatch or a truncated
+// file leaves the detector as it was.
+bool ReplaceDetector::Load(StateReader& in) {
+    std::string signature;
+    if (!in.GetString(signature) || signature != signature_)
+        return false;
+
+    struct LoadedEvent {
+        Event event;
+        UsnString directory;
+    };
+    struct LoadedFile {
+        FileIdKey key;
+        FileState state;
+        std::vector<uint64_t> words;
+        std::vector<LoadedEvent> recent;
+    };
+
+    std::vector<LoadedEvent> explorerEvents;
+    std::vector<Recent> explorer;
+    uint64_t count = 0;
+    if (!in.GetCount(count, 1) || count > kExplorerLength - 1)
+        return false;
+    for (size_t j = 0; j < count; ++j) {
+        LoadedEvent& loaded = explorerEvents.emplace_back();
+        Recent& r = explorer.emplace_back();
+        uint8_t wide = 0;
+        if (!LoadEvent(in, loaded.event, loaded.directory) || !in.Get(r.file) || !in.Get(wide) || !in.GetString(r.name))
+            return false;
+        r.wideId = wide != 0;
+        r.nameHash = HashBytes(r.name.data(), r.name.size() * sizeof(WCHAR));
+    }
+
+    const size_t words = automaton_.Words();
+    std::vector<LoadedFile> files;
+    if (!in.GetCount(count, sizeof(FileIdKey)))
+        return false;
+    for (size_t i = 0; i < count; ++i) {
+        LoadedFile& file = files.emplace_back();
+        uint8_t wide = 0;
+        if (!in.Get(file.key) || !in.Get(file.state.head) || !in.Get(wide) || !in.Get(file.state.lastDate)
+            || file.state.head >= window_)
+            return false;
+        file.state.wideId = wide != 0;
+        file.words.resize(words);
+        for (uint64_t& word : file.words)
+            if (!in.Get(word))
+                return false;
+        file.recent.resize(window_);
+        for (LoadedEvent& loaded : file.recent)
+            if (!LoadEvent(in, loaded.event, loaded.directory))
+                return false;
+    }
+
+    std::vector<std::vector<FileIdKey>> reported(reported_.size());
+    for (auto& keys : reported) {
+        if (!in.GetCount(count, sizeof(FileIdKey)))
+            return false;
+        keys.resize(static_cast<size_t>(count));
+        for (FileIdKey& key : keys)
+            if (!in.Get(key))
+                return false;
+    }
+
+    auto place = [&](LoadedEvent& loaded) {
+        if (loaded.event.directoryId != UsnEntryStore::kPendingDirectory)
+            loaded.event.directoryId = events_.InternDirectory(loaded.directory);
+        return loaded.event;
+    };
+    for (size_t j = 0; j < explorer.size(); ++j) {
+        explorer_[j] = std::move(explorer[j]);
+        explorer_[j].event = place(explorerEvents[j]);
+    }
+    explorerCount_ = explorer.size();
+    explorerHead_ = 0;
+
+    for (LoadedFile& file : files) {
+        if (count_ && Find(file.key))
+            continue;
+        uint32_t index = Insert(file.key);
+        states_[index - 1] = file.state;
+        std::copy(file.words.begin(), file.words.end(), words_.begin() + (index - 1) * words);
+        for (size_t k = 0; k < window_; ++k)
+            recent_[(index - 1) * window_ + k] = place(file.recent[k]);
+    }
+
+    for (size_t kind = 0; kind < reported.size(); ++kind)
+        for (FileIdKey key : reported[kind])
+            reported_[kind].Insert(key);
+    return true;
+}
+
+// Directory ids point into events_, which starts empty every run, so a known
+// directory is saved as its path.
+void ReplaceDetector::SaveEvent(StateWriter& out, const Event& event) const {
+    out.Put(event.usn);
+    out.Put(event.date);
+    out.Put(event.reason);
+    out.Put(event.parent);
+    bool known = event.directoryId != UsnEntryStore::kPendingDirectory;
+    out.Put<uint8_t>(known);
+    if (known)
+        out.PutString(events_.Directories().Get(event.directoryId));
+}
+
+// A known directory is returned in directory, to be interned by the caller;
+// its directoryId is left at 0 until then.
+bool ReplaceDetector::LoadEvent(StateReader& in, Event& event, UsnString& directory) {
+    uint8_t known = 0;
+    if (!in.Get(event.usn) || !in.Get(event.date) || !in.Get(event.reason) || !in.Get(event.parent) || !in.Get(known))
+        return false;
+    event.directoryId = known ? 0 : UsnEntryStore::kPendingDirectory;
+    return !known || in.GetString(directory);
+}
+
+size_t ReplaceDetector::Count(uint32_t kind) const {
+    return std::count_if(matches_.begin(), matches_.end(), [&](const ReplaceMatch& m) { return m.kind == kind; });
+}
+
+uint32_t ReplaceDetector::Find(FileIdKey key) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t slot = HashFileIdKey(key) & mask;; slot = (slot + 1) & mask) {
+        if (slots_[slot].state == 0 || slots_[slot].key == key)
+            return slots_[slot].state;
+    }
+}
+
+uint32_t ReplaceDetector::Insert(FileIdKey key) {
+    if ((count_ + 1) * 2 > slots_.size())
+        Rehash(slots_.empty() ? 1024 : slots_.size() * 2);
+
+    uint32_t state;
+    if (!freeStates_.empty()) {
+        state = freeStates_.back();
+        freeStates_.pop_back();
+        states_[state - 1] = FileState();
+        std::fill_n(words_.begin() + (state - 1) * automaton_.Words(), automaton_.Words(), 0);
+    }
+    else {
+        states_.emplace_back();
+        words_.resize(words_.size() + automaton_.Words());
+        recent_.resize(recent_.size() + window_);
+        state = static_cast<uint32_t>(states_.size());
+    }
+
+    size_t mask = slots_.size() - 1;
+    size_t slot = HashFileIdKey(key) & mask;
+    while (slots_[slot].state != 0)
+        slot = (slot + 1) & mask;
+    slots_[slot] = { key, state };
+    ++count_;
+    return state;
+}
+
+// Linear probing without tombstones: the entries after the hole that no
+// longer sit in their probe run are shifted back into it.
+void ReplaceDetector::Erase(FileIdKey key) {
+    size_t mask = slots_.size() - 1;
+    size_t hole = HashFileIdKey(key) & mask;
+    while (slots_[hole].state == 0 || !(slots_[hole].key == key))
+        hole = (hole + 1) & mask;
+
+    freeStates_.push_back(slots_[hole].state);
+    slots_[hole].state = 0;
+    --count_;
+
+    for (size_t slot = (hole + 1) & mask; slots_[slot].state != 0; slot = (slot + 1) & mask) {
+        size_t home = HashFileIdKey(slots_[slot].key) & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            slots_[hole] = slots_[slot];
+            slots_[slot].state = 0;
+            hole = slot;
+        }
+    }
+}
+
+void ReplaceDetector::Rehash(size_t slotCount) {
+    std::vector<Slot> old = std::move(slots_);
+    slots_.assign(slotCount, Slot{ {}, 0 });
+    size_t mask = slotCount - 1;
+    for (const Slot& entry : old) {
+        if (entry.state == 0)
+            continue;
+        size_t slot = HashFileIdKey(entry.key) & mask;
+        while (slots_[slot].state != 0)
+            slot = (slot + 1) & mask;
+        slots_[slot] = entry;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "usn_structs.h"
+#include "usn_entry_store.h"
+#include "usn_file_id.h"
+#include "usn_name_matcher.h"
+#include "usn_replace_patterns.h"
+#include "usn_state.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One detected replace: events [first, first + count) of the detector's store,
+// oldest first.
+struct ReplaceMatch {
+    uint32_t kind;  // index into ReplaceDetector::Kinds()
+    uint32_t first;
+    uint32_t count;
+};
+
+// Replace detection that runs while the journal is read. The per-file
+// patterns (built-in copy and type, and any loaded with --patterns) are
+// compiled into one PatternAutomaton and matched per file with a single
+// shift-and over its state words. A file is only tracked while some bit is
+// set, and dropped once it is deleted, so memory follows the partial matches
+// in flight rather than the journal size; every file reports each kind at
+// most once. The explorer pattern spans files, so it is matched on the last
+// four records of the journal itself, kept in a ring with their name hashes.
+// The events of each match are copied into Events() when its last record
+// arrives.
+class ReplaceDetector {
+public:
+    void Configure(const std::vector<ReplacePatternDef>& patterns, bool explorer);
+    bool enabled() const { return !patterns_.empty() || explorerKind_ != kNoKind; }
+
+    // Feeds entry i of store, the next accepted record in USN order.
+    void Push(const UsnEntryStore& store, size_t i);
+
+    // Replace kinds in report order: those of the patterns as they first
+    // appear, then "explorer".
+    const std::vector<std::string>& Kinds() const { return kinds_; }
+    bool IsExplorer(uint32_t kind) const { return kind == explorerKind_; }
+
+    UsnEntryStore& Events() { return events_; }
+    const UsnEntryStore& Events() const { return events_; }
+    const std::vector<ReplaceMatch>& Matches() const { return matches_; }
+    size_t Count(uint32_t kind) const;
+    size_t PendingFiles() const { return count_; }
+
+    // The partial matches in flight and the files already reported, for the
+    // next run to pick up where this one stopped. Load fails, and leaves the
+    // detector as it was, when the state was saved with other patterns.
+    void Save(StateWriter& out) const;
+    bool Load(StateReader& in);
+
+    // Drops the matches and their events once they are written (--follow).
+    // Interned strings stay, so events in flight keep their directories.
+    void ClearMatches() {
+        matches_.clear();
+        events_.RemoveIf([](size_t) { return true; });
+    }
+
+    // Drops every match for which remove(match) is true. Its events stay in
+    // the store.
+    template <class Predicate>
+    void RemoveMatchesIf(Predicate remove) {
+        std::erase_if(matches_, remove);
+    }
+
+private:
+    static constexpr uint32_t kNoKind = UINT32_MAX;
+    static constexpr size_t kExplorerLength = 4;
+
+    struct Pattern {
+        uint32_t kind;
+        uint32_t length;
+        bool named;  // only reported when names_ matches the file name
+    };
+
+    // What a match needs of an earlier record; the name is taken from the
+    // record that completes the match.
+    struct Event {
+        ULONGLONG usn;
+        FILETIME date;
+        DWORD reason;
+        FileIdKey parent;
+        uint32_t directoryId;  // in events_, set for V4 records only
+    };
+
+    // The automaton words and the last window_ events of a file live in
+    // words_ and recent_ at the file's index.
+    struct FileState {
+        uint32_t head = 0;  // slot the next event goes to
+        bool wideId = false;
+        ULONGLONG lastDate = 0;
+    };
+
+    // An explorer candidate: the record itself, its file and its name.
+    struct Recent {
+        Event event;
+        FileIdKey file;
+        bool wideId;
+        uint64_t nameHash;
+        UsnString name;
+    };
+
+    struct Slot {
+        FileIdKey key;
+        uint32_t state;  // index into states_ + 1, 0 = empty
+    };
+
+    void PushExplorer(const UsnEntryStore& store, size_t i);
+    void PushFile(const UsnEntryStore& store, size_t i);
+    uint32_t Find(FileIdKey key) const;
+    uint32_t Insert(FileIdKey key);
+    void Erase(FileIdKey key);
+    void Rehash(size_t slotCount);
+    void Report(uint32_t kind, uint32_t index, size_t length, const Event& last, FileIdKey file, UsnStringView name);
+    void SaveEvent(StateWriter& out, const Event& event) const;
+    static bool LoadEvent(StateReader& in, Event& event, UsnString& directory);
+
+    PatternAutomaton automaton_;
+    std::vector<Pattern> patterns_;
+    std::vector<NameMatcher> names_;  // one per pattern
+    std::vector<std::string> kinds_;
+    std::string signature_;  // the patterns as configured, checked by Load
+    uint32_t explorerKind_ = kNoKind;
+    size_t window_ = 1;  // longest pattern minus its last step
+
+    // Last records seen, oldest at explorerHead_ once the ring is full
+    Recent explorer_[kExplorerLength - 1];
+    size_t explorerCount_ = 0;
+    size_t explorerHead_ = 0;
+
+    // Files with a partial match in flight: open addressing over states_,
+    // whose freed slots are reused.
+    std::vector<Slot> slots_;
+    std::vector<FileState> states_;
+    std::vector<uint64_t> words_;
+    std::vector<Event> recent_;
+    std::vector<uint32_t> freeStates_;
+    size_t count_ = 0;
+
+    std::vector<FileIdSet> reported_;  // one per kind
+    UsnEntryStore events_;
+    std::vector<ReplaceMatch> matches_;
+};
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include "usn_replace_patterns.h"
+#include "usn_patterns.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <numeric>
+
+namespace {
+
+std::string_view Trim(std::string_view text) {
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front())))
+        text.remove_prefix(1);
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back())))
+        text.remove_suffix(1);
+    return text;
+}
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+        [](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+}
+
+// "Data Extend | Close" or "0x80000002"
+bool ParseStep(std::string_view text, DWORD& mask) {
+    mask = 0;
+    while (!text.empty()) {
+        size_t bar = text.find('|');
+        std::string_view name = Trim(text.substr(0, bar));
+        text = bar == std::string_view::npos ? std::string_view() : text.substr(bar + 1);
+
+        if (name.size() > 2 && name[0] == '0' && (name[1] == 'x' || name[1] == 'X')) {
+            DWORD value = 0;
+            auto result = std::from_chars(name.data() + 2, name.data() + name.size(), value, 16);
+            if (result.ec != std::errc() || result.ptr != name.data() + name.size())
+                return false;
+            mask |= value;
+            continue;
+        }
+
+        auto flag = std::find_if(std::begin(kReasonFlags), std::end(kReasonFlags),
+            [&](const ReasonFlag& r) { return EqualsIgnoreCase(r.desc, name); });
+        if (flag == std::end(kReasonFlags))
+            return false;
+        mask |= flag->flag;
+    }
+    return mask != 0;
+}
+
+template <size_t N>
+ReplacePatternDef MakePattern(const char* kind, const ReasonPattern<N>& steps) {
+    return { kind, std::vector<DWORD>(steps.begin(), steps.end()), {}, 0 };
+}
+
+}
+
+std::vector<ReplacePatternDef> BuiltinReplacePatterns(bool copy, bool type) {
+    std::vector<ReplacePatternDef> patterns;
+    if (copy) {
+        patterns.push_back(MakePattern("copy", COPY_PATTERN_1));
+        patterns.push_back(MakePattern("copy", COPY_PATTERN_2));
+    }
+    if (type) {
+        patterns.push_back(MakePattern("type", TYPE_PATTERN_1));
+        patterns.push_back(MakePattern("type", TYPE_PATTERN_2));
+    }
+    return patterns;
+}
+
+bool LoadReplacePatterns(const std::string& path, std::vector<ReplacePatternDef>& patterns, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    // A section's name and gap lines may come after its steps, so its
+    // patterns are only finished when the next section starts.
+    size_t sectionStart = patterns.size();
+    std::string kind;
+    std::vector<std::string> names;
+    ULONGLONG gap = 0;
+    auto finishSection = [&] {
+        for (size_t i = sectionStart; i < patterns.size(); ++i) {
+            patterns[i].names = names;
+            patterns[i].maxGap = gap;
+        }
+        sectionStart = patterns.size();
+        names.clear();
+        gap = 0;
+    };
+
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(in, line); ++lineNumber) {
+        std::string_view text = line;
+        text = Trim(text.substr(0, text.find('#')));
+        if (text.empty())
+            continue;
+
+        auto fail = [&](const std::string& what) {
+            error = path + ":" + std::to_string(lineNumber) + ": " + what;
+            return false;
+        };
+
+        if (text.front() == '[') {
+            if (text.back() != ']' || text.size() < 3)
+                return fail("bad section header");
+            finishSection();
+            kind = std::string(Trim(text.substr(1, text.size() - 2)));
+            std::transform(kind.begin(), kind.end(), kind.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+            if (kind == "explorer" || kind == "all")
+                return fail("\"" + kind + "\" is reserved");
+            continue;
+        }
+
+        size_t equals = text.find('=');
+        if (equals == std::string_view::npos)
+            return fail("expected key = value");
+        std::string_view key = Trim(text.substr(0, equals));
+        std::string_view value = Trim(text.substr(equals + 1));
+        if (kind.empty())
+            return fail("\"" + std::string(key) + "\" outside a [kind] section");
+
+        if (key == "steps") {
+            ReplacePatternDef pattern{ kind, {}, {}, 0 };
+            while (!value.empty()) {
+                size_t arrow = value.find('>');
+                DWORD mask;
+                if (!ParseStep(value.substr(0, arrow), mask))
+                    return fail("bad step \"" + std::string(Trim(value.substr(0, arrow))) + "\"");
+                pattern.steps.push_back(mask);
+                value = arrow == std::string_view::npos ? std::string_view() : value.substr(arrow + 1);
+            }
+            if (pattern.steps.empty() || pattern.steps.size() > 32)
+                return fail("a pattern needs 1 to 32 steps");
+            patterns.push_back(std::move(pattern));
+        }
+        else if (key == "name") {
+            while (!value.empty()) {
+                size_t semicolon = value.find(';');
+                std::string_view glob = Trim(value.substr(0, semicolon));
+                if (!glob.empty())
+                    names.emplace_back(glob);
+                value = semicolon == std::string_view::npos ? std::string_view() : value.substr(semicolon + 1);
+            }
+        }
+        else if (key == "gap") {
+            double seconds = 0;
+            auto result = std::from_chars(value.data(), value.data() + value.size(), seconds);
+            if (result.ec != std::errc() || result.ptr != value.data() + value.size() || seconds <= 0)
+                return fail("gap must be a positive number of seconds");
+            gap = static_cast<ULONGLONG>(seconds * 10000000);
+        }
+        else {
+            return fail("unknown key \"" + std::string(key) + "\"");
+        }
+    }
+    finishSection();
+    return true;
+}
+
+void PatternAutomaton::Compile(const std::vector<ReplacePatternDef>& patterns) {
+    *this = PatternAutomaton();
+    size_t bits = 0;
+    for (const auto& pattern : patterns)
+        bits += pattern.steps.size();
+    words_ = (bits + 63) / 64;
+    initial_.assign(words_, 0);
+    final_.assign(words_, 0);
+
+    std::vector<uint32_t> gapped;
+    std::vector<std::pair<size_t, size_t>> bitRange;
+    for (uint32_t p = 0; p < patterns.size(); ++p) {
+        size_t first = stepMasks_.size();
+        for (DWORD step : patterns[p].steps) {
+            stepMasks_.push_back(step);
+            patternOf_.push_back(p);
+        }
+        size_t last = stepMasks_.size() - 1;
+        initial_[first / 64] |= 1ULL << (first % 64);
+        final_[last / 64] |= 1ULL << (last % 64);
+        longest_ = std::max(longest_, patterns[p].steps.size());
+        bitRange.push_back({ first, last + 1 });
+        if (patterns[p].maxGap)
+            gapped.push_back(p);
+    }
+
+    std::sort(gapped.begin(), gapped.end(), [&](uint32_t a, uint32_t b) { return patterns[a].maxGap < patterns[b].maxGap; });
+    std::vector<uint64_t> row(words_, 0);
+    for (uint32_t p : gapped) {
+        for (size_t bit = bitRange[p].first; bit < bitRange[p].second; ++bit)
+            row[bit / 64] |= 1ULL << (bit % 64);
+        gaps_.push_back(patterns[p].maxGap);
+        expireMasks_.insert(expireMasks_.end(), row.begin(), row.end());
+    }
+}
+
+const uint64_t* PatternAutomaton::Accepts(DWORD reason) {
+    auto it = acceptsOf_.find(reason);
+    if (it == acceptsOf_.end()) {
+        size_t offset = accepts_.size();
+        accepts_.resize(offset + words_, 0);
+        DWORD folded = FoldNamedDataReasons(reason);
+        for (size_t bit = 0; bit < stepMasks_.size(); ++bit) {
+            if ((folded & stepMasks_[bit]) == stepMasks_[bit])
+                accepts_[offset + bit / 64] |= 1ULL << (bit % 64);
+        }
+        it = acceptsOf_.emplace(reason, offset).first;
+    }
+    return accepts_.data() + it->second;
+}
+
+void PatternAutomaton::Expire(uint64_t* state, ULONGLONG elapsed) const {
+    size_t expired = std::lower_bound(gaps_.begin(), gaps_.end(), elapsed) - gaps_.begin();
+    if (expired == 0)
+        return;
+    const uint64_t* mask = expireMasks_.data() + (expired - 1) * words_;
+    for (size_t w = 0; w < words_; ++w)
+        state[w] &= ~mask[w];
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "usn_platform.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A per-file replace pattern: consecutive records of one file whose reasons
+// carry the flags of each step in turn.
+struct ReplacePatternDef {
+    std::string kind;                 // replace type it reports, e.g. "copy"
+    std::vector<DWORD> steps;
+    std::vector<std::string> names;   // file name globs, any may match; empty = every name
+    ULONGLONG maxGap = 0;             // FILETIME ticks allowed between two steps, 0 = no limit
+};
+
+// The built-in copy and type patterns from usn_patterns.h.
+std::vector<ReplacePatternDef> BuiltinReplacePatterns(bool copy, bool type);
+
+// Reads a pattern file. Each [kind] section holds one or more
+// "steps = <flags> > <flags> > ..." lines, every one a pattern of its own,
+// where <flags> are reason names joined by "|". "name = *.exe;*.dll" and
+// "gap = <seconds>" apply to every pattern of the section. # starts a comment.
+bool LoadReplacePatterns(const std::string& path, std::vector<ReplacePatternDef>& patterns, std::string& error);
+
+// Every step of every pattern as one bit of a shared state vector, so a
+// file's matches all advance with one shift-and over a few words:
+//     state = ((state << 1) | Initial()) & Accepts(reason)
+// A bit is set while the file's last records match a pattern up to that
+// step. Accepts() is built once per distinct reason mask, so the cost per
+// record follows the number of words, not the number of patterns.
+class PatternAutomaton {
+public:
+    void Compile(const std::vector<ReplacePatternDef>& patterns);
+
+    size_t Words() const { return words_; }
+    size_t LongestPattern() const { return longest_; }
+    const uint64_t* Initial() const { return initial_.data(); }
+    const uint64_t* Final() const { return final_.data(); }
+    const uint64_t* Accepts(DWORD reason);
+
+    // Pattern whose last step is bit.
+    uint32_t PatternAt(size_t bit) const { return patternOf_[bit]; }
+
+    // Clears the bits of patterns whose gap is shorter than elapsed ticks.
+    void Expire(uint64_t* state, ULONGLONG elapsed) const;
+
+private:
+    size_t words_ = 0;
+    size_t longest_ = 0;
+    std::vector<DWORD> stepMasks_;     // one per bit
+    std::vector<uint32_t> patternOf_;  // one per bit
+    std::vector<uint64_t> initial_;
+    std::vector<uint64_t> final_;
+    std::vector<uint64_t> accepts_;    // words_ per distinct reason
+    std::unordered_map<DWORD, size_t> acceptsOf_;
+
+    // Gaps of the gapped patterns, ascending; row k of expireMasks_ holds
+    // the bits of the first k + 1 of them.
+    std::vector<ULONGLONG> gaps_;
+    std::vector<uint64_t> expireMasks_;
+};
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "usn_scan.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define USN_SCAN_SSE2
+#endif
+
+size_t SkipZeroSlots(const BYTE* data, size_t size) {
+    size_t i = 0;
+
+    // Coarse pass: 64 bytes per iteration until a block holds a set bit, the
+    // slot-wise loop below then pins down which 8-byte slot it was.
+#if defined(__AVX2__)
+    for (; i + 64 <= size; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        __m256i v = _mm256_or_si256(a, b);
+        if (!_mm256_testz_si256(v, v))
+            break;
+    }
+#elif defined(USN_SCAN_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 64 <= size; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 48));
+        __m128i v = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xFFFF)
+            break;
+    }
+#endif
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t slot;
+        memcpy(&slot, data + i, sizeof(slot));
+        if (slot != 0)
+            return i;
+    }
+
+    return size;
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "usn_platform.h"
+#include <cstddef>
+
+// Returns the offset of the first 8-byte slot in [data, data + size) that is not
+// all zeroes, or size when the rest of the range is zero. data must be 8-byte
+// aligned, like every USN record in a $J stream.
+size_t SkipZeroSlots(const BYTE* data, size_t size);
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "usn_platform.h"
+#include <cstdint>
+
+// Journal timestamps only ever run a little out of USN order, so a window
+// that starts this much before the threshold is sure to hold every record
+// at or past it. 5 minutes, in FILETIME ticks.
+constexpr ULONGLONG kSeekSlack = 5ULL * 60 * 10000000;
+
+// Binary search for where records reach a UTC timestamp threshold, over
+// positions in [low, high): byte offsets of a $J stream or live USNs.
+// sample(position, recordPosition, timestamp) reports the first record at or
+// after position and below high, returning false when there is none.
+// Returns a record position to start reading from; every record at or past
+// the threshold is at or after it. Stops once the window is below minSpan.
+template <class Sample>
+ULONGLONG SeekByTime(ULONGLONG low, ULONGLONG high, ULONGLONG threshold, ULONGLONG minSpan, Sample sample) {
+    ULONGLONG target = threshold > kSeekSlack ? threshold - kSeekSlack : 0;
+    ULONGLONG start = low;
+
+    while (high - low > minSpan) {
+        ULONGLONG mid = low + (((high - low) / 2) & ~7ULL);
+        ULONGLONG position = 0, timestamp = 0;
+        if (!sample(mid, position, timestamp) || timestamp >= target) {
+            high = mid;
+        }
+        else {
+            start = position;
+            low = position + 8;
+        }
+    }
+    return start;
+}
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "usn_source.h"
+#include "usn_record.h"
+#include "usn_scan.h"
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// Longer records would be corrupt: a V2 record with a 255 character name
+// takes under 600 bytes, a V4 record with its extents well under this.
+constexpr DWORD kMaxRecordLength = 64 * 1024;
+
+}
+
+size_t CompleteRecordsLength(const BYTE* data, size_t size) {
+    size_t pos = 0;
+    size_t complete = 0;
+    UsnRecordView rec;
+    while (size - pos >= sizeof(USN_RECORD_COMMON_HEADER)) {
+        if (ParseUsnRecord(data + pos, size - pos, rec)) {
+            pos += rec.recordLength;
+            complete = pos;
+            continue;
+        }
+
+        auto header = reinterpret_cast<const USN_RECORD_COMMON_HEADER*>(data + pos);
+        bool knownVersion = header->MajorVersion >= 2 && header->MajorVersion <= 4;
+        if (knownVersion && header->RecordLength > size - pos && header->RecordLength <= kMaxRecordLength
+            && (header->RecordLength & 7) == 0)
+            break;  // the rest of this record hasn't been written yet
+
+        // padding or garbage, which the parser steps over as well
+        pos += 8;
+        complete = pos;
+    }
+    return complete;
+}
+
+#ifdef _WIN32
+VolumeJournalSource::VolumeJournalSource(HANDLE volume, const USN_JOURNAL_DATA_V0& journal, USN startUsn)
+    : volume_(volume), journalId_(journal.UsnJournalID), nextUsn_(startUsn), buffer_(1024 * 1024) {
+}
+
+bool VolumeJournalSource::Next(JournalBatch& batch, std::chrono::milliseconds timeout) {
+    READ_USN_JOURNAL_DATA_V0 readData{};
+    readData.StartUsn = nextUsn_;
+    readData.ReasonMask = 0xFFFFFFFF;
+    readData.UsnJournalID = journalId_;
+    // wait in the kernel for the first record; Timeout is in seconds
+    readData.BytesToWaitFor = 1;
+    readData.Timeout = std::max<DWORDLONG>(1, (timeout.count() + 999) / 1000);
+
+    DWORD bytesReturned = 0;
+    if (!DeviceIoControl(volume_, FSCTL_READ_USN_JOURNAL, &readData, sizeof(readData),
+        buffer_.data(), static_cast<DWORD>(buffer_.size()), &bytesReturned, nullptr))
+        return false;  // the journal was deleted, or wrapped past nextUsn_
+
+    batch = JournalBatch();
+    batch.arrived = std::chrono::steady_clock::now();
+    if (bytesReturned >= sizeof(USN)) {
+        nextUsn_ = *reinterpret_cast<const USN*>(buffer_.data());
+        batch.data = buffer_.data() + sizeof(USN);
+        batch.size = bytesReturned - sizeof(USN);
+    }
+    batch.nextUsn = nextUsn_;
+    return true;
+}
+#endif
+
+FileJournalSource::FileJournalSource(const std::string& path, ULONGLONG offset, std::chrono::milliseconds pollInterval)
+    : file_(path, std::ios::binary), offset_(offset), pollInterval_(pollInterval) {
+}
+
+bool FileJournalSource::Next(JournalBatch& batch, std::chrono::milliseconds timeout) {
+    if (!file_.is_open())
+        return false;
+
+    pending_.erase(pending_.begin(), pending_.begin() + handedOut_);
+    offset_ += handedOut_;
+    handedOut_ = 0;
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (;;) {
+        // whatever was appended since the last look
+        file_.clear();
+        file_.seekg(0, std::ios::end);
+        ULONGLONG fileSize = static_cast<ULONGLONG>(file_.tellg());
+        ULONGLONG have = offset_ + pending_.size();
+        if (fileSize > have) {
+            size_t old = pending_.size();
+            pending_.resize(old + static_cast<size_t>(fileSize - have));
+            file_.seekg(static_cast<std::streamoff>(have));
+            file_.read(reinterpret_cast<char*>(pending_.data() + old), static_cast<std::streamsize>(fileSize - have));
+            pending_.resize(old + static_cast<size_t>(file_.gcount()));
+        }
+        else if (fileSize < offset_) {
+            return false;  // truncated: not the same file any more
+        }
+
+        handedOut_ = CompleteRecordsLength(pending_.data(), pending_.size());
+        auto now = std::chrono::steady_clock::now();
+        if (handedOut_ > 0 || now >= deadline)
+            break;
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(pollInterval_, deadline - now));
+    }
+
+    batch = JournalBatch();
+    batch.data = pending_.data();
+    batch.size = handedOut_;
+    batch.rawStream = true;
+    batch.offset = offset_;
+    batch.arrived = std::chrono::steady_clock::now();
+    return true;
+}
+
+ReplayJournalSource::ReplayJournalSource(const std::string& path, double recordsPerSecond)
+    : path_(path), rate_(recordsPerSecond) {
+}
+
+bool ReplayJournalSource::Open() {
+    if (!file_.Open(path_))
+        return false;
+
+    UsnRecordView rec;
+    for (const auto& [offset, length] : file_.DataRanges()) {
+        const BYTE* end = file_.data() + offset + length;
+        for (const BYTE* ptr = file_.data() + offset; ptr < end;) {
+            if (ParseUsnRecord(ptr, end - ptr, rec)) {
+                records_.push_back(ptr - file_.data());
+                ptr += rec.recordLength;
+                continue;
+            }
+            ptr += 8;
+            if (ptr < end)
+                ptr += SkipZeroSlots(ptr, end - ptr);
+        }
+    }
+    return true;
+}
+
+bool ReplayJournalSource::Next(JournalBatch& batch, std::chrono::milliseconds timeout) {
+    // keeps a batch to what a reader takes in a few milliseconds
+    const size_t maxBatch = 4096;
+    if (next_ == records_.size())
+        return false;
+
+    auto now = std::chrono::steady_clock::now();
+    if (!started_) {
+        start_ = now;
+        started_ = true;
+    }
+    auto dueAt = [&](size_t record) {
+        return start_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(record / rate_));
+    };
+
+    size_t due = records_.size();
+    if (rate_ > 0) {
+        if (dueAt(next_) > now) {
+            std::this_thread::sleep_until(std::min(dueAt(next_), now + timeout));
+            now = std::chrono::steady_clock::now();
+        }
+        double elapsed = std::chrono::duration<double>(now - start_).count();
+        due = std::min(records_.size(), static_cast<size_t>(elapsed * rate_) + 1);
+    }
+    due = std::min(due, next_ + maxBatch);
+
+    batch = JournalBatch();
+    batch.rawStream = true;
+    batch.arrived = rate_ > 0 ? dueAt(next_) : now;
+    if (due > next_) {
+        UsnRecordView rec;
+        const BYTE* last = file_.data() + records_[due - 1];
+        ParseUsnRecord(last, file_.data() + file_.size() - last, rec);
+        batch.data = file_.data() + records_[next_];
+        batch.size = last + rec.recordLength - batch.data;
+        batch.offset = records_[next_];
+        next_ = due;
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "usn_platform.h"
+#include "usn_mapped_file.h"
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Records handed out by a JournalSource: whole records only, valid until the
+// next call to Next().
+struct JournalBatch {
+    const BYTE* data = nullptr;
+    size_t size = 0;
+    bool rawStream = false;   // may hold padding or garbage between records, like a $J file
+    ULONGLONG offset = 0;     // file sources: where data starts in the file
+    USN nextUsn = 0;          // live volumes: where the next read starts
+    std::chrono::steady_clock::time_point arrived;  // when the records became available
+};
+
+// Where --follow gets new records from.
+class JournalSource {
+public:
+    virtual ~JournalSource() = default;
+
+    // Waits up to timeout for records past the last batch. An empty batch
+    // means none came in time; false means the source ended or failed.
+    virtual bool Next(JournalBatch& batch, std::chrono::milliseconds timeout) = 0;
+};
+
+#ifdef _WIN32
+// The journal of a live volume, read with FSCTL_READ_USN_JOURNAL, which
+// blocks in the kernel until records arrive.
+class VolumeJournalSource : public JournalSource {
+public:
+    VolumeJournalSource(HANDLE volume, const USN_JOURNAL_DATA_V0& journal, USN startUsn);
+    bool Next(JournalBatch& batch, std::chrono::milliseconds timeout) override;
+
+private:
+    HANDLE volume_;
+    DWORDLONG journalId_;
+    USN nextUsn_;
+    std::vector<BYTE> buffer_;
+};
+#endif
+
+// A journal file something keeps appending to, polled for growth. A record
+// at the end that is only partly written is held back until the rest is
+// there.
+class FileJournalSource : public JournalSource {
+public:
+    FileJournalSource(const std::string& path, ULONGLONG offset, std::chrono::milliseconds pollInterval);
+    bool Next(JournalBatch& batch, std::chrono::milliseconds timeout) override;
+
+private:
+    std::ifstream file_;
+    ULONGLONG offset_;   // file offset of pending_[0]
+    std::chrono::milliseconds pollInterval_;
+    std::vector<BYTE> pending_;
+    size_t handedOut_ = 0;  // bytes of pending_ in the last batch
+};
+
+// Replays the records of a recorded journal at a steady rate, so that
+// latency and throughput can be measured on any machine. A record's arrival
+// is the moment it is due, so a reader that falls behind shows up as latency.
+class ReplayJournalSource : public JournalSource {
+public:
+    // recordsPerSecond 0 hands out everything as fast as it is taken.
+    ReplayJournalSource(const std::string& path, double recordsPerSecond);
+    bool Open();
+    size_t size() const { return records_.size(); }
+    bool Next(JournalBatch& batch, std::chrono::milliseconds timeout) override;
+
+private:
+    std::string path_;
+    double rate_;
+    MappedFile file_;
+    std::vector<size_t> records_;  // offsets of the records, in order
+    size_t next_ = 0;
+    bool started_ = false;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Length of the prefix of [data, data + size) that holds only whole records,
+// padding and garbage; what follows is the start of a record still being
+// written.
+size_t CompleteRecordsLength(const BYTE* data, size_t size);
\ No newline at end of file
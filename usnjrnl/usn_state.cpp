@@ -0,0 +1,39 @@
+#include "usn_state.h"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+bool ReadStateFile(const std::string& path, std::string& bytes) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !in.bad();
+}
+
+bool WriteStateFile(const std::string& path, const std::string& bytes, std::string& error) {
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            error = "cannot create " + temp;
+            return false;
+        }
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        out.close();
+        if (!out) {
+            error = "cannot write " + temp;
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+        error = ec.message();
+        std::filesystem::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
\ No newline at end of file
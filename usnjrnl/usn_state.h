@@ -0,0 +1,116 @@
+#pragma once
+
+#include "usn_structs.h"
+#include "usn_file_id.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// The --state file: where the last run stopped reading and what the replace
+// detector and path resolution had in flight there, so the next run only
+// reads what is new. A raw little-endian dump in the layout of this build,
+// rejected on any version or size mismatch, in which case the journal is
+// simply read in full again.
+inline constexpr char kStateMagic[8] = { 'U', 'S', 'N', 'S', 'T', 'A', 'T', 'E' };
+inline constexpr uint32_t kStateVersion = 1;
+
+class StateWriter {
+public:
+    template <class T>
+    void Put(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        bytes_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class Char>
+    void PutString(std::basic_string_view<Char> text) {
+        Put<uint64_t>(text.size());
+        bytes_.append(reinterpret_cast<const char*>(text.data()), text.size() * sizeof(Char));
+    }
+    void PutString(const std::string& text) { PutString(std::string_view(text)); }
+    void PutString(const UsnString& text) { PutString(UsnStringView(text)); }
+
+    void PutFileId(const FileIdVariant& id) {
+        Put<uint8_t>(std::holds_alternative<FILE_ID_128>(id));
+        Put(MakeFileIdKey(id));
+    }
+
+    const std::string& Bytes() const { return bytes_; }
+
+private:
+    std::string bytes_;
+};
+
+// Reads what StateWriter wrote. Every getter fails once the data runs out,
+// and so do all later ones.
+class StateReader {
+public:
+    explicit StateReader(std::string_view bytes) : bytes_(bytes) {}
+
+    template <class T>
+    bool Get(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (!Take(sizeof(T)))
+            return false;
+        memcpy(&value, bytes_.data() + pos_ - sizeof(T), sizeof(T));
+        return true;
+    }
+
+    template <class Char>
+    bool GetString(std::basic_string<Char>& text) {
+        uint64_t size = 0;
+        if (!Get(size) || size > (bytes_.size() - pos_) / sizeof(Char))
+            return Fail();
+        text.resize(static_cast<size_t>(size));
+        memcpy(text.data(), bytes_.data() + pos_, text.size() * sizeof(Char));
+        pos_ += text.size() * sizeof(Char);
+        return true;
+    }
+
+    bool GetFileId(FileIdVariant& id) {
+        uint8_t wide = 0;
+        FileIdKey key;
+        if (!Get(wide) || !Get(key))
+            return false;
+        id = MakeFileIdVariant(key, wide != 0);
+        return true;
+    }
+
+    // A count about to be read: fails when even minSize bytes per item
+    // couldn't fit in what is left, so a corrupt file can't ask for huge
+    // allocations.
+    bool GetCount(uint64_t& count, size_t minSize) {
+        if (!Get(count) || count > (bytes_.size() - pos_) / std::max<size_t>(minSize, 1))
+            return Fail();
+        return true;
+    }
+
+    bool ok() const { return !failed_; }
+
+private:
+    bool Fail() {
+        failed_ = true;
+        return false;
+    }
+
+    bool Take(size_t size) {
+        if (failed_ || size > bytes_.size() - pos_)
+            return Fail();
+        pos_ += size;
+        return true;
+    }
+
+    std::string_view bytes_;
+    size_t pos_ = 0;
+    bool failed_ = false;
+};
+
+// False when the file doesn't exist or can't be read.
+bool ReadStateFile(const std::string& path, std::string& bytes);
+// Writes a temporary file next to path and renames it over path, so an
+// interrupted run leaves the previous state intact.
+bool WriteStateFile(const std::string& path, const std::string& bytes, std::string& error);
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "usn_thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t i = 1; i < threads; ++i)
+        workers_.emplace_back([this] { WorkerLoop(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0)
+        return;
+
+    if (workers_.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i)
+            task(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        count_ = count;
+        next_ = 0;
+        finished_ = 0;
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    RunTasks();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return finished_ == count_; });
+    task_ = nullptr;
+}
+
+void ThreadPool::RunTasks() {
+    for (;;) {
+        const std::function<void(size_t)>* task;
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!task_ || next_ >= count_)
+                return;
+            task = task_;
+            index = next_++;
+        }
+
+        (*task)(index);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (++finished_ == count_)
+            done_.notify_all();
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+        RunTasks();
+    }
+}
\ No newline at end of file
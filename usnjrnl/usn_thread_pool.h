@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for fork-join loops. The calling thread takes
+// part in every ParallelFor, so a pool of size 1 has no extra threads at all.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = 0);  // 0 = one per hardware thread
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size() + 1; }
+
+    // Runs task(i) for every i in [0, count) and returns once all have finished.
+    // Calls must not be nested or issued from several threads at once.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    void WorkerLoop();
+    void RunTasks();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(size_t)>* task_ = nullptr;
+    size_t count_ = 0;
+    size_t next_ = 0;
+    size_t finished_ = 0;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+};
\ No newline at end of file
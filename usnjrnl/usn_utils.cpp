@@ -1,22 +1,108 @@
 #include "usn_utils.h"
+#include <cstdio>
 
-std::string to_utf8(const std::wstring& wstr) {
+std::string to_utf8(UsnStringView wstr) {
     if (wstr.empty()) return std::string();
-    int size_needed = WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), (int)wstr.size(), nullptr, 0, nullptr, nullptr);
+#ifdef _WIN32
+    int size_needed = WideCharToMultiByte(CP_UTF8, 0, wstr.data(), (int)wstr.size(), nullptr, 0, nullptr, nullptr);
     std::string str(size_needed, 0);
-    WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), (int)wstr.size(), &str[0], size_needed, nullptr, nullptr);
+    WideCharToMultiByte(CP_UTF8, 0, wstr.data(), (int)wstr.size(), &str[0], size_needed, nullptr, nullptr);
     return str;
+#else
+    std::string str;
+    str.reserve(wstr.size());
+    for (size_t i = 0; i < wstr.size(); ++i) {
+        char32_t cp = wstr[i];
+        if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < wstr.size() && wstr[i + 1] >= 0xDC00 && wstr[i + 1] <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (wstr[i + 1] - 0xDC00);
+            ++i;
+        }
+        else if (cp >= 0xD800 && cp <= 0xDFFF) {
+            cp = 0xFFFD;
+        }
+
+        if (cp < 0x80) {
+            str += (char)cp;
+        }
+        else if (cp < 0x800) {
+            str += (char)(0xC0 | (cp >> 6));
+            str += (char)(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000) {
+            str += (char)(0xE0 | (cp >> 12));
+            str += (char)(0x80 | ((cp >> 6) & 0x3F));
+            str += (char)(0x80 | (cp & 0x3F));
+        }
+        else {
+            str += (char)(0xF0 | (cp >> 18));
+            str += (char)(0x80 | ((cp >> 12) & 0x3F));
+            str += (char)(0x80 | ((cp >> 6) & 0x3F));
+            str += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+    return str;
+#endif
+}
+
+UsnString from_utf8(std::string_view str) {
+    if (str.empty()) return UsnString();
+#ifdef _WIN32
+    int size_needed = MultiByteToWideChar(CP_UTF8, 0, str.data(), (int)str.size(), nullptr, 0);
+    UsnString wstr(size_needed, 0);
+    MultiByteToWideChar(CP_UTF8, 0, str.data(), (int)str.size(), &wstr[0], size_needed);
+    return wstr;
+#else
+    UsnString wstr;
+    wstr.reserve(str.size());
+    for (size_t i = 0; i < str.size();) {
+        unsigned char lead = str[i];
+        size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+        char32_t cp = length == 1 ? lead : length == 2 ? (lead & 0x1F) : length == 3 ? (lead & 0x0F) : (lead & 0x07);
+        bool valid = length != 0 && i + length <= str.size();
+        for (size_t k = 1; valid && k < length; ++k) {
+            unsigned char next = str[i + k];
+            valid = (next & 0xC0) == 0x80;
+            cp = (cp << 6) | (next & 0x3F);
+        }
+        if (!valid) {
+            wstr += (WCHAR)0xFFFD;
+            ++i;
+            continue;
+        }
+
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            wstr += (WCHAR)(0xD800 + (cp >> 10));
+            wstr += (WCHAR)(0xDC00 + (cp & 0x3FF));
+        }
+        else {
+            wstr += (WCHAR)cp;
+        }
+        i += length;
+    }
+    return wstr;
+#endif
 }
 
 std::string formatFileTime(const FILETIME& ft) {
     SYSTEMTIME st;
     FileTimeToSystemTime(&ft, &st);
-    char buffer[20];
-    sprintf_s(buffer, "%04d-%02d-%02d %02d:%02d:%02d",
+    char buffer[32];  // fits any WORD fields, not just valid dates
+    snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d %02d:%02d:%02d",
         st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
     return std::string(buffer);
 }
 
+UsnString JoinPath(UsnStringView parent, UsnStringView name) {
+    UsnString path;
+    path.reserve(parent.size() + name.size() + 1);
+    path.append(parent);
+    if (path.empty() || path.back() != USN_TEXT('\\'))
+        path.push_back(USN_TEXT('\\'));
+    path.append(name);
+    return path;
+}
+
 time_t parseDateTime(const std::string& datetimeStr) {
     std::tm tm = {};
     std::istringstream ss(datetimeStr);
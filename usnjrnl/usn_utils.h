@@ -1,11 +1,13 @@
-#pragma once
-
-#include <string>
-#include <Windows.h>
-#include <ctime>
-#include <sstream>
-#include <iomanip>
-
-std::string to_utf8(const std::wstring& wstr);
-std::string formatFileTime(const FILETIME& ft);
+#pragma once
+
+#include <string>
+#include "usn_structs.h"
+#include <ctime>
+#include <sstream>
+#include <iomanip>
+
+std::string to_utf8(UsnStringView wstr);
+UsnString from_utf8(std::string_view str);
+std::string formatFileTime(const FILETIME& ft);
+UsnString JoinPath(UsnStringView parent, UsnStringView name);
 time_t parseDateTime(const std::string& datetimeStr);
\ No newline at end of file